@@ -3,11 +3,13 @@
  * Copyright (C) 2020 Intel Corporation.
  */
 
+#include <linux/module.h>
+
 #include "iosm_ipc_chnl_cfg.h"
 
 /* Max. sizes of a downlink buffers */
 #define IPC_MEM_MAX_DL_FLASH_BUF_SIZE (16 * 1024)
-#define IPC_MEM_MAX_DL_LOOPBACK_SIZE (1 * 1024 * 1024)
+#define IPC_MEM_MAX_DL_LOOPBACK_SIZE (64 * 1024)
 #define IPC_MEM_MAX_DL_AT_BUF_SIZE 2048
 #define IPC_MEM_MAX_DL_RPC_BUF_SIZE (32 * 1024)
 #define IPC_MEM_MAX_DL_MBIM_BUF_SIZE IPC_MEM_MAX_DL_RPC_BUF_SIZE
@@ -26,6 +28,43 @@
 /* MUX acc backoff 1ms */
 #define IRQ_ACC_BACKOFF_MUX 1000
 
+/* Bounds for the TD count and DL buffer size overrides */
+#define IPC_CHNL_CFG_MIN_TDS 2
+#define IPC_CHNL_CFG_MAX_TDS 2048
+#define IPC_CHNL_CFG_MIN_BUF_SIZE 256
+#define IPC_CHNL_CFG_MAX_BUF_SIZE (1 * 1024 * 1024)
+
+/* Number of DSS channels, in VLAN id order starting at IPC_WWAN_DSS_ID_0 */
+#define IPC_CHNL_CFG_DSS_NR 5
+
+/* The parameters are evaluated when the channels are created, i.e. at
+ * probe for MBIM and when CP enters the run state for the DSS channels.
+ */
+static bool dss_enable[IPC_CHNL_CFG_DSS_NR] = { true, true, true, true,
+						true };
+module_param_array(dss_enable, bool, NULL, 0644);
+MODULE_PARM_DESC(dss_enable,
+		 "Create the RPC, IAT0, IAT1, loopback and trace channels");
+
+static uint dss_tds[IPC_CHNL_CFG_DSS_NR];
+module_param_array(dss_tds, uint, NULL, 0644);
+MODULE_PARM_DESC(dss_tds,
+		 "TDs per pipe of the RPC, IAT0, IAT1, loopback and trace channels (0 = default)");
+
+static uint dss_buf_size[IPC_CHNL_CFG_DSS_NR];
+module_param_array(dss_buf_size, uint, NULL, 0644);
+MODULE_PARM_DESC(dss_buf_size,
+		 "DL buffer size of the RPC, IAT0, IAT1, loopback and trace channels (0 = default)");
+
+static uint mbim_tds;
+module_param(mbim_tds, uint, 0644);
+MODULE_PARM_DESC(mbim_tds, "TDs per pipe of the MBIM channel (0 = default)");
+
+static uint mbim_buf_size;
+module_param(mbim_buf_size, uint, 0644);
+MODULE_PARM_DESC(mbim_buf_size,
+		 "DL buffer size of the MBIM channel (0 = default)");
+
 /* Modem channel configuration table
  * Always reserve element zero for flash channel.
  */
@@ -61,9 +100,33 @@ static struct ipc_chnl_cfg modem_cfg[] = {
 	  IPC_MEM_MAX_DL_MUX_LITE_BUF_SIZE },
 };
 
+/* Apply the module parameter overrides of the TD count and buffer size. */
+static void ipc_chnl_cfg_override(struct ipc_chnl_cfg *chnl_cfg, u32 tds,
+				  u32 buf_size)
+{
+	if (tds) {
+		if (tds < IPC_CHNL_CFG_MIN_TDS || tds > IPC_CHNL_CFG_MAX_TDS) {
+			pr_err("id %d: invalid td count %u", chnl_cfg->id, tds);
+		} else {
+			chnl_cfg->ul_nr_of_entries = tds;
+			chnl_cfg->dl_nr_of_entries = tds;
+		}
+	}
+
+	if (buf_size) {
+		if (buf_size < IPC_CHNL_CFG_MIN_BUF_SIZE ||
+		    buf_size > IPC_CHNL_CFG_MAX_BUF_SIZE)
+			pr_err("id %d: invalid buffer size %u", chnl_cfg->id,
+			       buf_size);
+		else
+			chnl_cfg->dl_buf_size = buf_size;
+	}
+}
+
 int ipc_chnl_cfg_get(struct ipc_chnl_cfg *chnl_cfg, int index)
 {
 	int array_size = ARRAY_SIZE(modem_cfg);
+	int dss;
 
 	if (index >= array_size) {
 		pr_err("index: %d and array_size %d", index, array_size);
@@ -82,5 +145,17 @@ int ipc_chnl_cfg_get(struct ipc_chnl_cfg *chnl_cfg, int index)
 	chnl_cfg->ul_pipe = modem_cfg[index].ul_pipe;
 	chnl_cfg->dl_pipe = modem_cfg[index].dl_pipe;
 
+	dss = chnl_cfg->id - IPC_WWAN_DSS_ID_0;
+
+	if (dss >= 0 && dss < IPC_CHNL_CFG_DSS_NR) {
+		if (!dss_enable[dss])
+			return -ENODEV;
+
+		ipc_chnl_cfg_override(chnl_cfg, dss_tds[dss],
+				      dss_buf_size[dss]);
+	} else if (chnl_cfg->id == IPC_MEM_MBIM_CTRL_CH_ID) {
+		ipc_chnl_cfg_override(chnl_cfg, mbim_tds, mbim_buf_size);
+	}
+
 	return 0;
 }
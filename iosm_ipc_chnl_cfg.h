@@ -44,11 +44,14 @@ struct ipc_chnl_cfg {
 };
 
 /**
- * ipc_chnl_cfg_get - Get pipe configuration.
+ * ipc_chnl_cfg_get - Get pipe configuration. The TD counts and the buffer
+ *		      size of the MBIM and DSS channels can be overridden by
+ *		      module parameters.
  * @chnl_cfg:		Array of ipc_chnl_cfg struct
  * @index:		Channel index (upto MAX_CHANNELS)
  *
- * Return: 0 on success and -1 on failure
+ * Return: 0 on success, -ENODEV if the channel is disabled by module
+ *	   parameter and -1 on failure
  */
 int ipc_chnl_cfg_get(struct ipc_chnl_cfg *chnl_cfg, int index);
 
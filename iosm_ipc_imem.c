@@ -3,7 +3,9 @@
  * Copyright (C) 2020 Intel Corporation.
  */
 
+#include <linux/idr.h>
 #include <linux/if_vlan.h>
+#include <linux/module.h>
 
 #include "iosm_ipc_chnl_cfg.h"
 #include "iosm_ipc_imem.h"
@@ -11,6 +13,21 @@
 #include "iosm_ipc_sio.h"
 #include "iosm_ipc_task_queue.h"
 
+/* Instance numbers of the modems for the char device names */
+static DEFINE_IDA(ipc_imem_ida);
+
+/* Build the char device name of this modem instance. The first modem keeps
+ * the plain name, the following ones get the instance number appended.
+ */
+static void ipc_imem_devname(struct iosm_imem *ipc_imem, const char *base,
+			     char *name, size_t len)
+{
+	if (ipc_imem->instance)
+		snprintf(name, len, "%s%d", base, ipc_imem->instance);
+	else
+		snprintf(name, len, "%s", base);
+}
+
 /* Check the wwan ips if it is valid with Channel as input. */
 static inline int ipc_imem_check_wwan_ips(struct ipc_mem_channel *chnl)
 {
@@ -20,17 +37,25 @@ static inline int ipc_imem_check_wwan_ips(struct ipc_mem_channel *chnl)
 	return false;
 }
 
-static int imem_msg_send_device_sleep(struct iosm_imem *ipc_imem, u32 state)
+/* Allow the device to sleep and enable the in-band crash signalling when
+ * entering the runtime phase. Both messages go behind one doorbell, nobody
+ * waits for the responses.
+ */
+static void imem_msg_send_runtime_config(struct iosm_imem *ipc_imem)
 {
-	union ipc_msg_prep_args prep_args = {
-		.sleep.target = 1,
-		.sleep.state = state,
-	};
-
-	ipc_imem->device_sleep = state;
-
-	return ipc_protocol_tq_msg_send(ipc_imem->ipc_protocol,
-					IPC_MSG_PREP_SLEEP, &prep_args, NULL);
+	struct ipc_msg_batch_entry entries[2] = {};
+	int nr = ARRAY_SIZE(entries);
+
+	entries[0].msg_type = IPC_MSG_PREP_SLEEP;
+	entries[0].prep_args.sleep.target = 1;
+	entries[0].prep_args.sleep.state = ipc_imem->device_sleep;
+	entries[1].msg_type = IPC_MSG_PREP_FEATURE_SET;
+	entries[1].prep_args.feature_set.reset_enable =
+		IPC_MEM_INBAND_CRASH_SIG;
+
+	if (ipc_protocol_tq_msg_send_batch(ipc_imem->ipc_protocol, entries,
+					   nr, false) < nr)
+		dev_err(ipc_imem->dev, "runtime config messages failed");
 }
 
 static bool imem_dl_skb_alloc(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe)
@@ -42,8 +67,45 @@ static bool imem_dl_skb_alloc(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe)
 	return ipc_protocol_dl_td_prepare(ipc_imem->ipc_protocol, pipe);
 }
 
-/* This timer handler will retry DL buff allocation if a pipe has no free buf
- * and gives doorbell if TD is available
+/* Fill the free DL TDs of the pipe and then its buffer reserve. A ring left
+ * below its depth is recorded as shortfall. Returns true if TDs were added.
+ */
+static bool imem_dl_pipe_refill(struct iosm_imem *ipc_imem,
+				struct ipc_pipe *pipe)
+{
+	bool processed = false;
+	u32 shortfall;
+
+	while (imem_dl_skb_alloc(ipc_imem, pipe))
+		processed = true;
+
+	shortfall = pipe->max_nr_of_queued_entries - pipe->nr_of_queued_entries;
+	if (!shortfall) {
+		ipc_protocol_dl_reserve_fill(ipc_imem->ipc_protocol, pipe);
+		return processed;
+	}
+
+	pipe->nr_of_dl_shortfall++;
+	if (shortfall > pipe->dl_shortfall_max)
+		pipe->dl_shortfall_max = shortfall;
+
+	return processed;
+}
+
+/* Start the DL buffer allocation retry with the current backoff period. */
+static void imem_td_alloc_timer_start(struct iosm_imem *ipc_imem)
+{
+	if (hrtimer_active(&ipc_imem->td_alloc_timer))
+		return;
+
+	ipc_imem->hrtimer_period =
+		ktime_set(0, ipc_imem->td_alloc_backoff_us * 1000ULL);
+	hrtimer_start(&ipc_imem->td_alloc_timer, ipc_imem->hrtimer_period,
+		      HRTIMER_MODE_REL);
+}
+
+/* This timer handler will retry DL buff allocation if a pipe is below its
+ * ring depth and gives doorbell if TD is available
  */
 static int imem_tq_td_alloc_timer(struct iosm_imem *ipc_imem, int arg,
 				  void *msg, size_t size)
@@ -55,13 +117,14 @@ static int imem_tq_td_alloc_timer(struct iosm_imem *ipc_imem, int arg,
 	for (i = 0; i < IPC_MEM_MAX_CHANNELS; i++) {
 		struct ipc_pipe *pipe = &ipc_imem->channels[i].dl_pipe;
 
-		if (!pipe->is_open || pipe->nr_of_queued_entries > 0)
+		if (!pipe->is_open || pipe->nr_of_queued_entries >=
+					      pipe->max_nr_of_queued_entries ||
+		    ipc_imem->channels[i].state == IMEM_CHANNEL_CLOSING)
 			continue;
 
-		while (imem_dl_skb_alloc(ipc_imem, pipe))
-			new_buffers_available = true;
+		new_buffers_available |= imem_dl_pipe_refill(ipc_imem, pipe);
 
-		if (pipe->nr_of_queued_entries == 0)
+		if (pipe->nr_of_queued_entries < pipe->max_nr_of_queued_entries)
 			retry_allocation = true;
 	}
 
@@ -69,14 +132,18 @@ static int imem_tq_td_alloc_timer(struct iosm_imem *ipc_imem, int arg,
 		ipc_protocol_doorbell_trigger(ipc_imem->ipc_protocol,
 					      IPC_HP_DL_PROCESS);
 
-	if (retry_allocation) {
-		ipc_imem->hrtimer_period =
-		ktime_set(0, IPC_TD_ALLOC_TIMER_PERIOD_MS * 1000 * 1000ULL);
-		if (!hrtimer_active(&ipc_imem->td_alloc_timer))
-			hrtimer_start(&ipc_imem->td_alloc_timer,
-				      ipc_imem->hrtimer_period,
-				      HRTIMER_MODE_REL);
+	if (!retry_allocation) {
+		ipc_imem->td_alloc_backoff_us = IPC_TD_ALLOC_BACKOFF_MIN_US;
+		return 0;
 	}
+
+	/* Back off while the allocation makes no progress. */
+	if (!new_buffers_available)
+		ipc_imem->td_alloc_backoff_us =
+			min_t(u32, ipc_imem->td_alloc_backoff_us * 2,
+			      IPC_TD_ALLOC_TIMER_PERIOD_MS * 1000);
+
+	imem_td_alloc_timer_start(ipc_imem);
 	return 0;
 }
 
@@ -85,8 +152,7 @@ static enum hrtimer_restart imem_td_alloc_timer_cb(struct hrtimer *hr_timer)
 	struct iosm_imem *ipc_imem =
 		container_of(hr_timer, struct iosm_imem, td_alloc_timer);
 	/* Post an async tasklet event to trigger HP update Doorbell */
-	ipc_task_queue_send_task(ipc_imem, imem_tq_td_alloc_timer, 0, NULL, 0,
-				 false);
+	ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_TD_ALLOC);
 	return HRTIMER_NORESTART;
 }
 
@@ -105,11 +171,17 @@ static enum hrtimer_restart imem_fast_update_timer_cb(struct hrtimer *hr_timer)
 	struct iosm_imem *ipc_imem =
 		container_of(hr_timer, struct iosm_imem, fast_update_timer);
 	/* Post an async tasklet event to trigger HP update Doorbell */
-	ipc_task_queue_send_task(ipc_imem, imem_tq_fast_update_timer_cb, 0,
-				 NULL, 0, false);
+	ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_FAST_UPDATE);
 	return HRTIMER_NORESTART;
 }
 
+/* Number of IP sessions offered to CP. CP rejects the OPEN_SESSION of an
+ * if_id it does not support.
+ */
+static uint mux_sessions = IPC_MEM_MUX_IP_SESSION_ENTRIES;
+module_param(mux_sessions, uint, 0444);
+MODULE_PARM_DESC(mux_sessions, "Number of MUX IP sessions (1-256)");
+
 static int imem_setup_cp_mux_cap_init(struct iosm_imem *ipc_imem,
 				      struct ipc_mux_config *cfg)
 {
@@ -130,24 +202,62 @@ static int imem_setup_cp_mux_cap_init(struct iosm_imem *ipc_imem,
 	 * for channel alloc function.
 	 */
 	cfg->instance_id = IPC_MEM_MUX_IP_CH_VLAN_ID;
-	cfg->nr_sessions = IPC_MEM_MUX_IP_SESSION_ENTRIES;
+	cfg->nr_sessions = clamp_t(int, mux_sessions, 1,
+				   IPC_MEM_MUX_IP_SESSION_MAX);
 
 	return 0;
 }
 
+/**
+ * struct imem_feature_set_rsp - Response of a feature set message nobody
+ *				 waits for
+ * @rsp:	Response object, completed by the done callback
+ * @dev:	Device for the error report
+ */
+struct imem_feature_set_rsp {
+	struct ipc_rsp rsp;
+	struct device *dev;
+};
+
+/* Report a failed feature set message and release its response. */
+static void imem_feature_set_done(struct ipc_rsp *rsp)
+{
+	struct imem_feature_set_rsp *fs_rsp =
+		container_of(rsp, struct imem_feature_set_rsp, rsp);
+
+	if (rsp->status != IPC_MEM_MSG_CS_SUCCESS)
+		dev_err(fs_rsp->dev, "feature set failed, status %d",
+			rsp->status);
+
+	kfree(fs_rsp);
+}
+
 void imem_msg_send_feature_set(struct iosm_imem *ipc_imem,
 			       unsigned int reset_enable, bool atomic_ctx)
 {
 	union ipc_msg_prep_args prep_args = { .feature_set.reset_enable =
 						      reset_enable };
+	struct imem_feature_set_rsp *fs_rsp;
 
-	if (atomic_ctx)
+	if (atomic_ctx) {
 		ipc_protocol_tq_msg_send(ipc_imem->ipc_protocol,
 					 IPC_MSG_PREP_FEATURE_SET, &prep_args,
 					 NULL);
-	else
-		ipc_protocol_msg_send(ipc_imem->ipc_protocol,
-				      IPC_MSG_PREP_FEATURE_SET, &prep_args);
+		return;
+	}
+
+	/* The writer does not wait up to the message timeout for CP. */
+	fs_rsp = kzalloc(sizeof(*fs_rsp), GFP_KERNEL);
+	if (!fs_rsp)
+		return;
+
+	fs_rsp->dev = ipc_imem->dev;
+	fs_rsp->rsp.done = imem_feature_set_done;
+
+	if (ipc_protocol_msg_send_async(ipc_imem->ipc_protocol,
+					IPC_MSG_PREP_FEATURE_SET, &prep_args,
+					&fs_rsp->rsp))
+		kfree(fs_rsp);
 }
 
 void imem_td_update_timer_start(struct iosm_imem *ipc_imem)
@@ -162,7 +272,7 @@ void imem_td_update_timer_start(struct iosm_imem *ipc_imem)
 
 	if (!hrtimer_active(&ipc_imem->tdupdate_timer)) {
 		ipc_imem->hrtimer_period =
-		ktime_set(0, TD_UPDATE_DEFAULT_TIMEOUT_USEC * 1000ULL);
+		ktime_set(0, READ_ONCE(ipc_imem->td_update_usec) * 1000ULL);
 		if (!hrtimer_active(&ipc_imem->tdupdate_timer))
 			hrtimer_start(&ipc_imem->tdupdate_timer,
 				      ipc_imem->hrtimer_period,
@@ -170,6 +280,16 @@ void imem_td_update_timer_start(struct iosm_imem *ipc_imem)
 	}
 }
 
+void imem_td_update_window_set(struct iosm_imem *ipc_imem, u32 usec)
+{
+	if (!usec)
+		usec = TD_UPDATE_DEFAULT_TIMEOUT_USEC;
+
+	WRITE_ONCE(ipc_imem->td_update_usec,
+		   clamp_t(u32, usec, TD_UPDATE_MIN_TIMEOUT_USEC,
+			   TD_UPDATE_DEFAULT_TIMEOUT_USEC));
+}
+
 void imem_hrtimer_stop(struct hrtimer *hr_timer)
 {
 	if (hrtimer_active(hr_timer))
@@ -260,12 +380,19 @@ static void imem_dl_skb_process(struct iosm_imem *ipc_imem,
 	/* An AT/control or IP packet is expected. */
 	switch (pipe->channel->ctype) {
 	case IPC_CTYPE_FLASH:
+		/* Only the net layer takes a frame of several buffers. */
+		if (skb_linearize(skb))
+			goto rcv_err;
+
 		/* Pass the packet to the char layer. */
 		if (imem_sys_sio_receive(ipc_imem->sio, skb))
 			goto rcv_err;
 		break;
 
 	case IPC_CTYPE_MBIM:
+		if (skb_linearize(skb))
+			goto rcv_err;
+
 		/* Pass the packet to the char layer. */
 		if (imem_sys_sio_receive(ipc_imem->mbim, skb))
 			goto rcv_err;
@@ -292,11 +419,16 @@ static void imem_dl_skb_process(struct iosm_imem *ipc_imem,
 					    IPC_CB(skb)->mapping,
 					    IPC_CB(skb)->direction);
 
-			if (ipc_wwan_receive(ipc_imem->wwan, skb, true))
+			if (ipc_wwan_receive(ipc_imem->wwan, skb,
+					     htons(ETH_P_802_3)))
 				pipe->channel->net_err_count++;
 			/* DL packet through IP MUX layer */
 		} else if (pipe->channel->vlan_id ==
 			   IPC_MEM_MUX_IP_CH_VLAN_ID) {
+			/* The decoder parses the ADB in one buffer. */
+			if (skb_linearize(skb))
+				goto rcv_err;
+
 			ipc_mux_dl_decode(ipc_imem->mux, skb);
 		}
 		break;
@@ -310,9 +442,12 @@ rcv_err:
 	ipc_pcie_kfree_skb(ipc_imem->pcie, skb);
 }
 
-/* Process the downlink data and pass them to the char or net layer. */
-static void imem_dl_pipe_process(struct iosm_imem *ipc_imem,
-				 struct ipc_pipe *pipe)
+/* Process the downlink data and pass them to the char or net layer. At most
+ * budget TDs are handled, the others stay for the next run. Returns the
+ * number of handled TDs.
+ */
+static int imem_dl_pipe_process(struct iosm_imem *ipc_imem,
+				struct ipc_pipe *pipe, int budget)
 {
 	s32 cnt = 0, processed_td_cnt = 0;
 	struct ipc_mem_channel *channel;
@@ -331,8 +466,15 @@ static void imem_dl_pipe_process(struct iosm_imem *ipc_imem,
 			cnt = pipe->nr_of_entries - pipe->old_tail + tail;
 	}
 
+	cnt = min_t(s32, cnt, budget);
 	processed_td_cnt = cnt;
 
+	/* DL of the control channels keeps the modem awake, the MUX codec
+	 * accounts the IP data.
+	 */
+	if (cnt && !ipc_imem_check_wwan_ips(channel))
+		ipc_pcie_pm_activity(ipc_imem->pcie);
+
 	/* Seek for pipes with pending DL data. */
 	while (cnt--) {
 		skb = ipc_protocol_dl_td_process(ipc_imem->ipc_protocol, pipe);
@@ -341,9 +483,11 @@ static void imem_dl_pipe_process(struct iosm_imem *ipc_imem,
 		imem_dl_skb_process(ipc_imem, pipe, skb);
 	}
 
-	/* try to allocate new empty DL SKbs from head..tail - 1*/
-	while (imem_dl_skb_alloc(ipc_imem, pipe))
-		processed = true;
+	/* try to allocate new empty DL SKbs from head..tail - 1. A closing
+	 * channel gets no new buffers.
+	 */
+	processed = channel->state != IMEM_CHANNEL_CLOSING &&
+		    imem_dl_pipe_refill(ipc_imem, pipe);
 
 	if (processed && !ipc_imem_check_wwan_ips(channel)) {
 		/* Force HP update for non IP channels */
@@ -368,6 +512,8 @@ static void imem_dl_pipe_process(struct iosm_imem *ipc_imem,
 
 	if (ipc_imem->app_notify_dl_pend)
 		complete(&ipc_imem->dl_pend_sem);
+
+	return processed_td_cnt;
 }
 
 /* process open uplink pipe */
@@ -547,6 +693,141 @@ static int imem_send_mdm_rdy_cb(struct iosm_imem *ipc_imem, int arg, void *msg,
 	return 0;
 }
 
+/* Reset a pipe dropped by CP. The MUX ADBs on the way are returned to the
+ * free list, the TD and skbuf rings are kept for the reopen.
+ */
+static void imem_recovery_pipe_reset(struct iosm_imem *ipc_imem,
+				     struct ipc_pipe *pipe)
+{
+	struct sk_buff *skb;
+	u32 head, tail;
+
+	pipe->is_open = false;
+
+	if (pipe->skbr_start && ipc_imem->mux) {
+		ipc_protocol_get_head_tail_index(ipc_imem->ipc_protocol, pipe,
+						 &head, NULL);
+
+		for (tail = pipe->old_tail; tail != head;
+		     tail = (tail + 1) % pipe->nr_of_entries) {
+			skb = pipe->skbr_start[tail];
+			if (!skb || IPC_CB(skb)->op_type != UL_MUX_OP_ADB)
+				continue;
+
+			pipe->skbr_start[tail] = NULL;
+			ipc_mux_ul_encoded_process(ipc_imem->mux, skb);
+		}
+	}
+
+	/* Empty the uplink skb accumulator. */
+	while ((skb = skb_dequeue(&pipe->channel->ul_list))) {
+		if (IPC_CB(skb)->op_type == UL_MUX_OP_ADB && ipc_imem->mux)
+			ipc_mux_ul_encoded_process(ipc_imem->mux, skb);
+		else
+			ipc_pcie_kfree_skb(ipc_imem->pcie, skb);
+	}
+
+	ipc_protocol_pipe_reset(ipc_imem->ipc_protocol, pipe);
+}
+
+/* Drop the IPC state of the crashed CP in tasklet context. */
+static int imem_tq_recovery_reset(struct iosm_imem *ipc_imem, int arg,
+				  void *msg, size_t size)
+{
+	struct ipc_mem_channel *channel;
+	int i;
+
+	for (i = 0; i < ipc_imem->nr_of_channels; i++) {
+		channel = &ipc_imem->channels[i];
+
+		if (channel->state != IMEM_CHANNEL_ACTIVE)
+			continue;
+
+		imem_recovery_pipe_reset(ipc_imem, &channel->ul_pipe);
+		imem_recovery_pipe_reset(ipc_imem, &channel->dl_pipe);
+
+		/* Reopen the channel once CP is back in RUN. */
+		channel->state = IMEM_CHANNEL_RECOVERY;
+
+		/* Release a writer blocked on the lost pipe. */
+		complete(&channel->ul_sem);
+	}
+
+	if (ipc_imem->mux)
+		ipc_mux_recovery_reset(ipc_imem->mux);
+
+	ipc_protocol_reset(ipc_imem->ipc_protocol);
+
+	ipc_imem->enter_runtime = 0;
+	ipc_imem->ipc_status = IPC_MEM_DEVICE_IPC_UNINIT;
+	ipc_imem->ipc_requested_state = IPC_MEM_DEVICE_IPC_DONT_CARE;
+	ipc_imem->td_update_timer_suspended = false;
+
+	return 0;
+}
+
+/* Reset the IPC layer after a modem crash and wait for CP to restart. The
+ * net devices, the MUX ADB pool and the TD rings stay allocated.
+ */
+static void ipc_imem_recovery_worker(struct work_struct *instance)
+{
+	struct iosm_imem *ipc_imem;
+
+	ipc_imem = container_of(instance, struct iosm_imem, recovery_worker);
+
+	if (ipc_imem->phase == IPC_P_OFF_REQ)
+		return;
+
+	dev_dbg(ipc_imem->dev, "%s: reset the IPC state",
+		ipc_ap_phase_get_string(ipc_imem->phase));
+
+	cancel_work_sync(&ipc_imem->run_state_worker);
+
+	imem_hrtimer_stop(&ipc_imem->tdupdate_timer);
+	imem_hrtimer_stop(&ipc_imem->fast_update_timer);
+	imem_hrtimer_stop(&ipc_imem->td_alloc_timer);
+
+	ipc_task_queue_send_task(ipc_imem, imem_tq_recovery_reset, 0, NULL, 0,
+				 true);
+
+	/* Offer the flash device again in case CP restarts in ROM. */
+	if (!ipc_imem->sio) {
+		char name_flash[IPC_SIO_DEVNAME_LEN];
+
+		ipc_imem_devname(ipc_imem, "iat", name_flash,
+				 sizeof(name_flash));
+		ipc_imem->sio = ipc_sio_init(ipc_imem, name_flash);
+	}
+
+	/* Poll the CP execution stage until it is back in RUN. */
+	ipc_imem->hrtimer_period =
+		ktime_set(0, IPC_IMEM_RECOVERY_POLL_MS * 1000 * 1000ULL);
+	if (!hrtimer_active(&ipc_imem->startup_timer))
+		hrtimer_start(&ipc_imem->startup_timer,
+			      ipc_imem->hrtimer_period, HRTIMER_MODE_REL);
+}
+
+/* Reopen the channels and MUX sessions which were active before the modem
+ * crash. The pipes of all channels are opened in one message round trip.
+ */
+static void imem_recovery_reopen(struct iosm_imem *ipc_imem)
+{
+	int channel_ids[IPC_MEM_MAX_CHANNELS];
+	int nr = 0;
+	int i;
+
+	for (i = 0; i < ipc_imem->nr_of_channels; i++)
+		if (ipc_imem->channels[i].state == IMEM_CHANNEL_RECOVERY)
+			channel_ids[nr++] = i;
+
+	if (nr && imem_channels_open(ipc_imem, channel_ids, nr,
+				     IPC_HP_NET_CHANNEL_INIT))
+		dev_err(ipc_imem->dev, "not all channels reopened");
+
+	if (ipc_imem->mux)
+		ipc_mux_recovery_reopen(ipc_imem->mux);
+}
+
 /* This function is executed in a task context via an ipc_worker object,
  * as the creation or removal of device can't be done from tasklet.
  */
@@ -564,6 +845,12 @@ static void ipc_imem_run_state_worker(struct work_struct *instance)
 		return;
 	}
 
+	/* The net and char devices survived a modem crash. */
+	if (ipc_imem->wwan) {
+		imem_recovery_reopen(ipc_imem);
+		goto remove_sio;
+	}
+
 	if (!imem_setup_cp_mux_cap_init(ipc_imem, &mux_cfg)) {
 		ipc_imem->mux = mux_init(&mux_cfg, ipc_imem);
 		if (ipc_imem->mux)
@@ -574,6 +861,7 @@ static void ipc_imem_run_state_worker(struct work_struct *instance)
 	if (ipc_imem->mux)
 		ipc_imem->mux->wwan = ipc_imem->wwan;
 
+remove_sio:
 	/* Remove boot sio device */
 	ipc_sio_deinit(ipc_imem->sio);
 
@@ -586,13 +874,11 @@ static void ipc_imem_run_state_worker(struct work_struct *instance)
 static void imem_handle_irq(struct iosm_imem *ipc_imem, int irq)
 {
 	enum ipc_mem_device_ipc_state curr_ipc_status;
+	int dl_budget = IMEM_DL_TD_BUDGET;
 	enum ipc_phase old_phase, phase;
 	bool retry_allocation = false;
 	bool ul_pending = false;
-	int ch_id, i;
-
-	if (irq != IMEM_IRQ_DONT_CARE)
-		ipc_imem->ev_irq_pending[irq] = false;
+	int ch_id, first, i;
 
 	/* Get the internal phase. */
 	old_phase = ipc_imem->phase;
@@ -616,12 +902,7 @@ static void imem_handle_irq(struct iosm_imem *ipc_imem, int irq)
 			/* allow device to sleep, default value is
 			 * IPC_HOST_SLEEP_ENTER_SLEEP
 			 */
-			imem_msg_send_device_sleep(ipc_imem,
-						   ipc_imem->device_sleep);
-
-			imem_msg_send_feature_set(ipc_imem,
-						  IPC_MEM_INBAND_CRASH_SIG,
-						  true);
+			imem_msg_send_runtime_config(ipc_imem);
 		}
 
 		curr_ipc_status =
@@ -670,16 +951,29 @@ static void imem_handle_irq(struct iosm_imem *ipc_imem, int irq)
 	/* process message ring */
 	ipc_protocol_msg_process(ipc_imem, irq);
 
-	/* process all open pipes */
+	/* One view of the tail pointers for all pipes of this round. */
+	ipc_protocol_tail_snapshot(ipc_imem->ipc_protocol);
+
+	/* Process all open pipes. The round starts at the pipe after the one
+	 * which used up the DL budget last time, so a pipe at the end of the
+	 * channel table is not starved by busy pipes in front of it.
+	 */
+	first = ipc_imem->dl_budget_next;
 	for (i = 0; i < IPC_MEM_MAX_CHANNELS; i++) {
-		struct ipc_pipe *ul_pipe = &ipc_imem->channels[i].ul_pipe;
-		struct ipc_pipe *dl_pipe = &ipc_imem->channels[i].dl_pipe;
+		int ch = (first + i) % IPC_MEM_MAX_CHANNELS;
+		struct ipc_pipe *ul_pipe = &ipc_imem->channels[ch].ul_pipe;
+		struct ipc_pipe *dl_pipe = &ipc_imem->channels[ch].dl_pipe;
 
-		if (dl_pipe->is_open &&
+		if (dl_pipe->is_open && dl_budget > 0 &&
 		    (irq == IMEM_IRQ_DONT_CARE || irq == dl_pipe->irq)) {
-			imem_dl_pipe_process(ipc_imem, dl_pipe);
-
-			if (dl_pipe->nr_of_queued_entries == 0)
+			dl_budget -= imem_dl_pipe_process(ipc_imem, dl_pipe,
+							  dl_budget);
+			if (dl_budget <= 0)
+				ipc_imem->dl_budget_next =
+					(ch + 1) % IPC_MEM_MAX_CHANNELS;
+
+			if (dl_pipe->nr_of_queued_entries <
+			    dl_pipe->max_nr_of_queued_entries)
 				retry_allocation = true;
 		}
 
@@ -699,7 +993,7 @@ static void imem_handle_irq(struct iosm_imem *ipc_imem, int irq)
 	/* if UL data is pending restart TD update timer */
 	if (ul_pending) {
 		ipc_imem->hrtimer_period =
-		ktime_set(0, TD_UPDATE_DEFAULT_TIMEOUT_USEC * 1000ULL);
+		ktime_set(0, READ_ONCE(ipc_imem->td_update_usec) * 1000ULL);
 		if (!hrtimer_active(&ipc_imem->tdupdate_timer))
 			hrtimer_start(&ipc_imem->tdupdate_timer,
 				      ipc_imem->hrtimer_period,
@@ -723,16 +1017,27 @@ static void imem_handle_irq(struct iosm_imem *ipc_imem, int irq)
 	/* Reset the expected CP state. */
 	ipc_imem->ipc_requested_state = IPC_MEM_DEVICE_IPC_DONT_CARE;
 
-	if (retry_allocation) {
-		ipc_imem->hrtimer_period =
-		ktime_set(0, IPC_TD_ALLOC_TIMER_PERIOD_MS * 1000 * 1000ULL);
-		if (!hrtimer_active(&ipc_imem->td_alloc_timer))
-			hrtimer_start(&ipc_imem->td_alloc_timer,
-				      ipc_imem->hrtimer_period,
-				      HRTIMER_MODE_REL);
+	if (retry_allocation)
+		imem_td_alloc_timer_start(ipc_imem);
+
+	/* Let the other tasks and softirqs run, the DL TDs left over are
+	 * handled by the next run of the irq event.
+	 */
+	if (dl_budget <= 0 && irq >= 0) {
+		ipc_imem->dl_budget_exhausted++;
+		ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_IRQ + irq);
 	}
 }
 
+/* Tasklet call to do uplink transfer. */
+static int imem_tq_sio_write(struct iosm_imem *ipc_imem, int arg, void *msg,
+			     size_t size)
+{
+	imem_ul_send(ipc_imem);
+
+	return 0;
+}
+
 /* Callback by tasklet for handling interrupt events. */
 static int imem_tq_irq_cb(struct iosm_imem *ipc_imem, int arg, void *msg,
 			  size_t size)
@@ -793,6 +1098,16 @@ void imem_ul_send(struct iosm_imem *ipc_imem)
 		imem_td_update_timer_start(ipc_imem);
 }
 
+/* Start the warm restart when CP leaves the runtime phase by a crash. */
+static void imem_recovery_start(struct iosm_imem *ipc_imem)
+{
+	if (ipc_imem->phase == IPC_P_CRASH ||
+	    ipc_imem->phase == IPC_P_CD_READY || !ipc_imem->enter_runtime)
+		return;
+
+	schedule_work(&ipc_imem->recovery_worker);
+}
+
 /* Check the execution stage and update the AP phase */
 static enum ipc_phase imem_ap_phase_update_check(struct iosm_imem *ipc_imem,
 						 enum ipc_mem_exec_stage stage)
@@ -827,12 +1142,15 @@ static enum ipc_phase imem_ap_phase_update_check(struct iosm_imem *ipc_imem,
 		if (ipc_imem->phase != IPC_P_CRASH)
 			ipc_uevent_send(ipc_imem->dev, UEVENT_CRASH);
 
+		imem_recovery_start(ipc_imem);
 		ipc_imem->phase = IPC_P_CRASH;
 		break;
 
 	case IPC_MEM_EXEC_STAGE_CD_READY:
 		if (ipc_imem->phase != IPC_P_CD_READY)
 			ipc_uevent_send(ipc_imem->dev, UEVENT_CD_READY);
+
+		imem_recovery_start(ipc_imem);
 		ipc_imem->phase = IPC_P_CD_READY;
 		break;
 
@@ -847,20 +1165,6 @@ static enum ipc_phase imem_ap_phase_update_check(struct iosm_imem *ipc_imem,
 	return ipc_imem->phase;
 }
 
-/* Send msg to device to open pipe */
-static bool imem_pipe_open(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe)
-{
-	union ipc_msg_prep_args prep_args = {
-		.pipe_open.pipe = pipe,
-	};
-
-	if (ipc_protocol_msg_send(ipc_imem->ipc_protocol,
-				  IPC_MSG_PREP_PIPE_OPEN, &prep_args) == 0)
-		pipe->is_open = true;
-
-	return pipe->is_open;
-}
-
 /* Allocates the TDs for the given pipe along with firing HP update DB. */
 static int imem_tq_pipe_td_alloc(struct iosm_imem *ipc_imem, int arg, void *msg,
 				 size_t size)
@@ -872,6 +1176,8 @@ static int imem_tq_pipe_td_alloc(struct iosm_imem *ipc_imem, int arg, void *msg,
 	for (i = 0; i < dl_pipe->nr_of_entries - 1; i++)
 		processed |= imem_dl_skb_alloc(ipc_imem, dl_pipe);
 
+	ipc_protocol_dl_reserve_fill(ipc_imem->ipc_protocol, dl_pipe);
+
 	/* Trigger the doorbell irq to inform CP that new downlink buffers are
 	 * available.
 	 */
@@ -886,8 +1192,7 @@ static enum hrtimer_restart imem_td_update_timer_cb(struct hrtimer *hr_timer)
 	struct iosm_imem *ipc_imem =
 		container_of(hr_timer, struct iosm_imem, tdupdate_timer);
 
-	ipc_task_queue_send_task(ipc_imem, imem_tq_td_update_timer_cb, 0, NULL,
-				 0, false);
+	ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_TD_UPDATE);
 	return HRTIMER_NORESTART;
 }
 
@@ -945,6 +1250,83 @@ void imem_pipe_close(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe)
 	imem_pipe_cleanup(ipc_imem, pipe);
 }
 
+/* Take back the TDs CP returned after the abort of the channel pipes and
+ * mark the pipes closed. Aborted DL buffers are discarded, the DL TDs are
+ * not refilled.
+ */
+static int imem_tq_pipes_drain(struct iosm_imem *ipc_imem, int arg,
+			       void *msg, size_t size)
+{
+	struct ipc_mem_channel *channel = msg;
+	struct ipc_pipe *dl_pipe = &channel->dl_pipe;
+	struct sk_buff *skb;
+	u32 tail = 0;
+	s32 cnt = 0;
+
+	ipc_protocol_tail_snapshot(ipc_imem->ipc_protocol);
+
+	if (channel->ul_pipe.is_open)
+		imem_ul_pipe_process(ipc_imem, &channel->ul_pipe);
+
+	ipc_protocol_get_head_tail_index(ipc_imem->ipc_protocol, dl_pipe,
+					 NULL, &tail);
+	if (dl_pipe->is_open && dl_pipe->old_tail != tail) {
+		if (dl_pipe->old_tail < tail)
+			cnt = tail - dl_pipe->old_tail;
+		else
+			cnt = dl_pipe->nr_of_entries - dl_pipe->old_tail + tail;
+	}
+
+	while (cnt--) {
+		skb = ipc_protocol_dl_td_process(ipc_imem->ipc_protocol,
+						 dl_pipe);
+		imem_dl_skb_process(ipc_imem, dl_pipe, skb);
+	}
+
+	channel->ul_pipe.is_open = false;
+	channel->dl_pipe.is_open = false;
+
+	return 0;
+}
+
+void imem_channel_pipes_close(struct iosm_imem *ipc_imem,
+			      struct ipc_mem_channel *channel)
+{
+	struct ipc_msg_batch_entry entries[2] = {};
+
+	/* No new UL TDs for the pipes. */
+	channel->state = IMEM_CHANNEL_CLOSING;
+
+	/* CP gives the in-flight buffers back with IPC_MEM_TD_CS_ABORT. The
+	 * pipes stay open until these TDs are processed.
+	 */
+	entries[0].msg_type = IPC_MSG_PREP_PIPE_ABORT;
+	entries[0].prep_args.pipe_abort.pipe = &channel->ul_pipe;
+	entries[1].msg_type = IPC_MSG_PREP_PIPE_ABORT;
+	entries[1].prep_args.pipe_abort.pipe = &channel->dl_pipe;
+
+	/* Without the abort CP keeps the TDs, the pipes are closed and the
+	 * buffers freed by the cleanup below.
+	 */
+	if (!ipc_protocol_msg_send_batch(ipc_imem->ipc_protocol, entries,
+					 ARRAY_SIZE(entries)))
+		ipc_task_queue_send_task(ipc_imem, imem_tq_pipes_drain, 0,
+					 channel, 0, true);
+
+	/* Close both pipes behind one doorbell. */
+	memset(entries, 0, sizeof(entries));
+	entries[0].msg_type = IPC_MSG_PREP_PIPE_CLOSE;
+	entries[0].prep_args.pipe_close.pipe = &channel->ul_pipe;
+	entries[1].msg_type = IPC_MSG_PREP_PIPE_CLOSE;
+	entries[1].prep_args.pipe_close.pipe = &channel->dl_pipe;
+
+	ipc_protocol_msg_send_batch(ipc_imem->ipc_protocol, entries,
+				    ARRAY_SIZE(entries));
+
+	imem_pipe_cleanup(ipc_imem, &channel->ul_pipe);
+	imem_pipe_cleanup(ipc_imem, &channel->dl_pipe);
+}
+
 void imem_channel_close(struct iosm_imem *ipc_imem, int channel_id)
 {
 	struct ipc_mem_channel *channel;
@@ -967,54 +1349,173 @@ void imem_channel_close(struct iosm_imem *ipc_imem, int channel_id)
 		/* Release only the channel id. */
 		goto channel_free;
 
-	if (ipc_imem->phase == IPC_P_RUN) {
-		imem_pipe_close(ipc_imem, &channel->ul_pipe);
-		imem_pipe_close(ipc_imem, &channel->dl_pipe);
+	/* CP has already dropped the pipes of a crashed session. */
+	if (ipc_imem->phase == IPC_P_RUN &&
+	    channel->state != IMEM_CHANNEL_RECOVERY) {
+		imem_channel_pipes_close(ipc_imem, channel);
+	} else {
+		imem_pipe_cleanup(ipc_imem, &channel->ul_pipe);
+		imem_pipe_cleanup(ipc_imem, &channel->dl_pipe);
 	}
 
-	imem_pipe_cleanup(ipc_imem, &channel->ul_pipe);
-	imem_pipe_cleanup(ipc_imem, &channel->dl_pipe);
-
 channel_free:
 	imem_channel_free(channel);
 }
 
-struct ipc_mem_channel *imem_channel_open(struct iosm_imem *ipc_imem,
-					  int channel_id, u32 db_id)
+/* Release the pipes of a channel whose open did not complete. */
+static void imem_channel_open_abort(struct iosm_imem *ipc_imem,
+				    struct ipc_mem_channel *channel)
+{
+	if (channel->dl_pipe.is_open)
+		imem_pipe_close(ipc_imem, &channel->dl_pipe);
+	else
+		imem_pipe_cleanup(ipc_imem, &channel->dl_pipe);
+
+	if (channel->ul_pipe.is_open)
+		imem_pipe_close(ipc_imem, &channel->ul_pipe);
+	else
+		imem_pipe_cleanup(ipc_imem, &channel->ul_pipe);
+
+	imem_channel_free(channel);
+}
+
+int imem_channels_open(struct iosm_imem *ipc_imem, const int *channel_ids,
+		       int nr, u32 db_id)
 {
+	struct ipc_msg_batch_entry *entries;
 	struct ipc_mem_channel *channel;
+	int result = 0;
+	int i;
 
-	if (channel_id < 0 || channel_id >= IPC_MEM_MAX_CHANNELS) {
-		dev_err(ipc_imem->dev, "invalid channel ID: %d", channel_id);
-		return NULL;
+	if (nr <= 0)
+		return -EINVAL;
+
+	for (i = 0; i < nr; i++)
+		if (channel_ids[i] < 0 ||
+		    channel_ids[i] >= IPC_MEM_MAX_CHANNELS) {
+			dev_err(ipc_imem->dev, "invalid channel ID: %d",
+				channel_ids[i]);
+			return -EINVAL;
+		}
+
+	/* One OPEN_PIPE message per UL and DL pipe. */
+	entries = kcalloc(2 * nr, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		channel = &ipc_imem->channels[channel_ids[i]];
+		channel->state = IMEM_CHANNEL_ACTIVE;
+
+		entries[2 * i].msg_type = IPC_MSG_PREP_PIPE_OPEN;
+		entries[2 * i].prep_args.pipe_open.pipe = &channel->ul_pipe;
+		entries[2 * i + 1].msg_type = IPC_MSG_PREP_PIPE_OPEN;
+		entries[2 * i + 1].prep_args.pipe_open.pipe = &channel->dl_pipe;
 	}
 
-	channel = &ipc_imem->channels[channel_id];
+	/* The per message status is evaluated below. */
+	ipc_protocol_msg_send_batch(ipc_imem->ipc_protocol, entries, 2 * nr);
+
+	for (i = 0; i < nr; i++) {
+		channel = &ipc_imem->channels[channel_ids[i]];
+
+		channel->ul_pipe.is_open = entries[2 * i].response.status ==
+					   IPC_MEM_MSG_CS_SUCCESS;
+		channel->dl_pipe.is_open = entries[2 * i + 1].response.status ==
+					   IPC_MEM_MSG_CS_SUCCESS;
+
+		/* Allocate the downlink buffers in tasklet context. */
+		if (channel->ul_pipe.is_open && channel->dl_pipe.is_open &&
+		    !ipc_task_queue_send_lane(ipc_imem, IPC_TASK_LANE_DATA,
+					      imem_tq_pipe_td_alloc, db_id,
+					      &channel->dl_pipe, 0, false))
+			continue;
+
+		dev_err(ipc_imem->dev, "ch[%d]: open failed", channel_ids[i]);
+		imem_channel_open_abort(ipc_imem, channel);
+		result = -EIO;
+	}
+
+	kfree(entries);
+	return result;
+}
+
+/* Only the MUX channel is opened right after startup, the IP sessions need
+ * it anyway. MBIM and the DSS channels are opened on request, an unused
+ * open pipe would bind DL buffers and queue data nobody reads.
+ */
+static bool imem_channel_is_startup(struct iosm_imem *ipc_imem,
+				    struct ipc_mem_channel *channel)
+{
+	return ipc_imem->mux && channel->ctype == IPC_CTYPE_WWAN &&
+	       channel->index == ipc_imem->mux->instance_id;
+}
+
+void imem_channels_startup_open(struct iosm_imem *ipc_imem)
+{
+	int channel_ids[IPC_MEM_MAX_CHANNELS];
+	struct ipc_mem_channel *channel;
+	int nr = 0;
+	int ch_id;
+	int i;
+
+	for (i = 0; i < ipc_imem->nr_of_channels; i++) {
+		channel = &ipc_imem->channels[i];
+
+		if (!imem_channel_is_startup(ipc_imem, channel))
+			continue;
+
+		ch_id = imem_channel_alloc(ipc_imem, channel->index,
+					   channel->ctype);
+		if (ch_id >= 0)
+			channel_ids[nr++] = ch_id;
+	}
+
+	if (!nr)
+		return;
+
+	/* Failed channels are released and opened again by their user. */
+	if (imem_channels_open(ipc_imem, channel_ids, nr,
+			       IPC_HP_NET_CHANNEL_INIT))
+		dev_err(ipc_imem->dev, "not all startup channels opened");
+
+	for (i = 0; i < nr; i++) {
+		channel = &ipc_imem->channels[channel_ids[i]];
+		channel->startup_open = channel->state == IMEM_CHANNEL_ACTIVE;
+	}
+}
+
+int imem_channel_startup_claim(struct iosm_imem *ipc_imem, int index,
+			       enum ipc_ctype ctype)
+{
+	struct ipc_mem_channel *channel;
+	int i;
 
-	channel->state = IMEM_CHANNEL_ACTIVE;
+	for (i = 0; i < ipc_imem->nr_of_channels; i++) {
+		channel = &ipc_imem->channels[i];
 
-	if (!imem_pipe_open(ipc_imem, &channel->ul_pipe))
-		goto ul_pipe_err;
+		if (channel->ctype != ctype || channel->index != index)
+			continue;
 
-	if (!imem_pipe_open(ipc_imem, &channel->dl_pipe))
-		goto dl_pipe_err;
+		if (!channel->startup_open ||
+		    channel->state != IMEM_CHANNEL_ACTIVE)
+			return -1;
 
-	/* Allocate the downlink buffers in tasklet context. */
-	if (ipc_task_queue_send_task(ipc_imem, imem_tq_pipe_td_alloc, db_id,
-				     &channel->dl_pipe, 0, false)) {
-		dev_err(ipc_imem->dev, "td allocation failed : %d", channel_id);
-		goto task_failed;
+		channel->startup_open = false;
+		return i;
 	}
 
+	return -1;
+}
+
+struct ipc_mem_channel *imem_channel_open(struct iosm_imem *ipc_imem,
+					  int channel_id, u32 db_id)
+{
+	if (imem_channels_open(ipc_imem, &channel_id, 1, db_id))
+		return NULL;
+
 	/* Active channel. */
-	return channel;
-task_failed:
-	imem_pipe_close(ipc_imem, &channel->dl_pipe);
-dl_pipe_err:
-	imem_pipe_close(ipc_imem, &channel->ul_pipe);
-ul_pipe_err:
-	imem_channel_free(channel);
-	return NULL;
+	return &ipc_imem->channels[channel_id];
 }
 
 int ipc_imem_pm_suspend(struct iosm_imem *ipc_imem)
@@ -1047,6 +1548,7 @@ void imem_channel_free(struct ipc_mem_channel *channel)
 {
 	/* Reset dynamic channel elements. */
 	channel->sio_id = -1;
+	channel->startup_open = false;
 	channel->state = IMEM_CHANNEL_FREE;
 }
 
@@ -1187,6 +1689,16 @@ void imem_pipe_cleanup(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe)
 	 */
 	pipe->is_open = false;
 
+	if (pipe->nr_of_aborted_entries)
+		dev_dbg(ipc_imem->dev, "pipe %d: %u TDs aborted", pipe->pipe_nr,
+			pipe->nr_of_aborted_entries);
+
+	if (pipe->nr_of_dl_shortfall || pipe->nr_of_dl_reserve_used)
+		dev_dbg(ipc_imem->dev,
+			"pipe %d: %u short refills (max %u), %u reserve TDs",
+			pipe->pipe_nr, pipe->nr_of_dl_shortfall,
+			pipe->dl_shortfall_max, pipe->nr_of_dl_reserve_used);
+
 	/* Empty the uplink skb accumulator. */
 	while ((skb = skb_dequeue(&pipe->channel->ul_list)))
 		ipc_pcie_kfree_skb(ipc_imem->pcie, skb);
@@ -1234,6 +1746,9 @@ void ipc_imem_cleanup(struct iosm_imem *ipc_imem)
 
 	ipc_imem_device_ipc_uninit(ipc_imem);
 
+	/* The recovery worker may restart the startup timer. */
+	cancel_work_sync(&ipc_imem->recovery_worker);
+
 	hrtimer_cancel(&ipc_imem->td_alloc_timer);
 
 	hrtimer_cancel(&ipc_imem->tdupdate_timer);
@@ -1257,9 +1772,14 @@ void ipc_imem_cleanup(struct iosm_imem *ipc_imem)
 
 	ipc_sio_deinit(ipc_imem->sio);
 
-	ipc_protocol_deinit(ipc_imem->ipc_protocol);
+	dev_dbg(ipc_imem->dev, "DL budget exhausted %u times",
+		ipc_imem->dl_budget_exhausted);
 
+	/* The tasklet no longer completes the responses of CP. */
 	tasklet_kill(ipc_imem->ipc_tasklet);
+
+	ipc_protocol_deinit(ipc_imem->ipc_protocol);
+
 	kfree(ipc_imem->ipc_tasklet);
 	ipc_imem->ipc_tasklet = NULL;
 
@@ -1267,6 +1787,8 @@ void ipc_imem_cleanup(struct iosm_imem *ipc_imem)
 
 	kfree(ipc_imem->mmio);
 
+	ida_free(&ipc_imem_ida, ipc_imem->instance);
+
 	ipc_imem->phase = IPC_P_OFF;
 
 	ipc_imem->pcie = NULL;
@@ -1342,24 +1864,29 @@ static int ipc_imem_config(struct iosm_imem *ipc_imem)
 struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 				void __iomem *mmio, struct device *dev)
 {
-	struct iosm_imem *ipc_imem = kzalloc(sizeof(*pcie->imem), GFP_KERNEL);
+	struct iosm_imem *ipc_imem = kzalloc_node(sizeof(*pcie->imem),
+						  GFP_KERNEL, dev_to_node(dev));
 
 	struct ipc_chnl_cfg chnl_cfg_flash = { 0 };
 	struct ipc_chnl_cfg chnl_cfg_mbim = { 0 };
 
 	char name_flash[32] = { 0 }; /* Holds Flash device name */
 	char name_mbim[32] = { 0 }; /* Holds mbim device name */
+	int i;
 
 	if (!ipc_imem)
 		return NULL;
 
+	ipc_imem->instance = ida_alloc(&ipc_imem_ida, GFP_KERNEL);
+	if (ipc_imem->instance < 0)
+		goto instance_alloc_fail;
+
 	/* Save the device address. */
 	ipc_imem->pcie = pcie;
 	ipc_imem->dev = dev;
 
 	ipc_imem->pci_device_id = device_id;
 
-	ipc_imem->ev_sio_write_pending = false;
 	ipc_imem->cp_version = 0;
 	ipc_imem->device_sleep = IPC_HOST_SLEEP_ENTER_SLEEP;
 
@@ -1376,8 +1903,8 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 		goto mmio_init_fail;
 	}
 
-	ipc_imem->ipc_tasklet =
-		kzalloc(sizeof(*ipc_imem->ipc_tasklet), GFP_KERNEL);
+	ipc_imem->ipc_tasklet = kzalloc_node(sizeof(*ipc_imem->ipc_tasklet),
+					     GFP_KERNEL, dev_to_node(dev));
 
 	if (!ipc_imem->ipc_tasklet)
 		goto ipc_tasklet_init_fail;
@@ -1389,7 +1916,21 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 	if (!ipc_imem->ipc_task)
 		goto ipc_task_init_fail;
 
+	for (i = 0; i < IPC_IRQ_VECTORS; i++)
+		ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_IRQ + i,
+					  imem_tq_irq_cb, i);
+
+	ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_SIO_WRITE,
+				  imem_tq_sio_write, 0);
+	ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_TD_UPDATE,
+				  imem_tq_td_update_timer_cb, 0);
+	ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_FAST_UPDATE,
+				  imem_tq_fast_update_timer_cb, 0);
+	ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_TD_ALLOC,
+				  imem_tq_td_alloc_timer, 0);
+
 	INIT_WORK(&ipc_imem->run_state_worker, ipc_imem_run_state_worker);
+	INIT_WORK(&ipc_imem->recovery_worker, ipc_imem_recovery_worker);
 
 	ipc_imem->ipc_protocol = ipc_protocol_init(ipc_imem);
 
@@ -1404,7 +1945,7 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 	 */
 	imem_channel_init(ipc_imem, IPC_CTYPE_FLASH, chnl_cfg_flash, 0);
 
-	snprintf(name_flash, sizeof(name_flash) - 1, "iat");
+	ipc_imem_devname(ipc_imem, "iat", name_flash, sizeof(name_flash));
 
 	ipc_imem->sio = ipc_sio_init(ipc_imem, name_flash);
 
@@ -1415,7 +1956,7 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 		imem_channel_init(ipc_imem, IPC_CTYPE_MBIM, chnl_cfg_mbim,
 				  IRQ_MOD_OFF);
 
-	snprintf(name_mbim, sizeof(name_mbim) - 1, "wwanctrl");
+	ipc_imem_devname(ipc_imem, "wwanctrl", name_mbim, sizeof(name_mbim));
 
 	ipc_imem->mbim = ipc_mbim_init(ipc_imem, name_mbim);
 
@@ -1431,6 +1972,7 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 	hrtimer_init(&ipc_imem->tdupdate_timer, CLOCK_MONOTONIC,
 		     HRTIMER_MODE_REL);
 	ipc_imem->tdupdate_timer.function = imem_td_update_timer_cb;
+	ipc_imem->td_update_usec = TD_UPDATE_DEFAULT_TIMEOUT_USEC;
 
 	hrtimer_init(&ipc_imem->fast_update_timer, CLOCK_MONOTONIC,
 		     HRTIMER_MODE_REL);
@@ -1439,6 +1981,7 @@ struct iosm_imem *ipc_imem_init(struct iosm_pcie *pcie, unsigned int device_id,
 	hrtimer_init(&ipc_imem->td_alloc_timer, CLOCK_MONOTONIC,
 		     HRTIMER_MODE_REL);
 	ipc_imem->td_alloc_timer.function = imem_td_alloc_timer_cb;
+	ipc_imem->td_alloc_backoff_us = IPC_TD_ALLOC_BACKOFF_MIN_US;
 
 	if (ipc_imem_config(ipc_imem)) {
 		dev_err(ipc_imem->dev, "failed to initialize the imem");
@@ -1459,6 +2002,7 @@ sio_init_fail:
 	imem_channel_reset(ipc_imem);
 	ipc_protocol_deinit(ipc_imem->ipc_protocol);
 protocol_init_fail:
+	cancel_work_sync(&ipc_imem->recovery_worker);
 	cancel_work_sync(&ipc_imem->run_state_worker);
 	ipc_task_queue_deinit(ipc_imem->ipc_task);
 ipc_task_init_fail:
@@ -1467,18 +2011,17 @@ ipc_task_init_fail:
 ipc_tasklet_init_fail:
 	kfree(ipc_imem->mmio);
 mmio_init_fail:
+	ida_free(&ipc_imem_ida, ipc_imem->instance);
+instance_alloc_fail:
 	kfree(ipc_imem);
 	return NULL;
 }
 
 void ipc_imem_irq_process(struct iosm_imem *ipc_imem, int irq)
 {
-	/* Debounce IPC_EV_IRQ. */
-	if (ipc_imem && ipc_imem->ipc_task && !ipc_imem->ev_irq_pending[irq]) {
-		ipc_imem->ev_irq_pending[irq] = true;
-		ipc_task_queue_send_task(ipc_imem, imem_tq_irq_cb, irq, NULL, 0,
-					 false);
-	}
+	/* MSIs which arrive before the tasklet has run are handled once. */
+	if (ipc_imem && ipc_imem->ipc_task)
+		ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_IRQ + irq);
 }
 
 void imem_td_update_timer_suspend(struct iosm_imem *ipc_imem, bool suspend)
@@ -51,6 +51,22 @@ struct ipc_chnl_cfg;
  */
 #define IPC_TD_ALLOC_TIMER_PERIOD_MS 100
 
+/* First period of the TD allocation retry. It doubles after each retry
+ * without new DL buffers up to IPC_TD_ALLOC_TIMER_PERIOD_MS.
+ * unit : microseconds
+ */
+#define IPC_TD_ALLOC_BACKOFF_MIN_US 50
+
+/* Number of premapped DL buffers held back per pipe for the refill when the
+ * atomic allocation fails.
+ */
+#define IPC_MEM_DL_RESERVE_SIZE 8
+
+/* Poll period of the CP execution stage after a modem crash.
+ * unit : milliseconds
+ */
+#define IPC_IMEM_RECOVERY_POLL_MS 100
+
 /* Channel Index for SW download */
 #define IPC_MEM_FLASH_CH_ID 0
 
@@ -75,14 +91,23 @@ struct ipc_chnl_cfg;
 
 #define IMEM_IRQ_DONT_CARE (-1)
 
+/* Maximum number of DL TDs handled by one run of the irq event. */
+#define IMEM_DL_TD_BUDGET 256
+
 #define IPC_MEM_MAX_CHANNELS 8
 
 #define IPC_MEM_MUX_IP_SESSION_ENTRIES 8
 
+/* The MUX if_id is a u8, which limits the number of IP sessions. */
+#define IPC_MEM_MUX_IP_SESSION_MAX 256
+
 #define IPC_MEM_MUX_IP_CH_VLAN_ID (-1)
 
 #define TD_UPDATE_DEFAULT_TIMEOUT_USEC 1900
 
+/* Shortest TD update doorbell delay for a fast UL link. */
+#define TD_UPDATE_MIN_TIMEOUT_USEC 100
+
 #define FORCE_UPDATE_DEFAULT_TIMEOUT_USEC 500
 
 /* Sleep_message, target host: not applicable  / target device: CP is
@@ -103,6 +128,9 @@ struct ipc_chnl_cfg;
  */
 #define IPC_MEM_DL_ETH_OFFSET 16
 
+/* Max. size of a DL frame which CP spreads over several TDs */
+#define IPC_MEM_MAX_DL_FRAME_SIZE (1 * 1024 * 1024)
+
 #define IPC_CB(skb) ((struct ipc_skb_cb *)((skb)->cb))
 
 /* List of the supported UL/DL pipes. */
@@ -140,6 +168,7 @@ enum ipc_channel_state {
 	IMEM_CHANNEL_RESERVED,
 	IMEM_CHANNEL_ACTIVE,
 	IMEM_CHANNEL_CLOSING,
+	IMEM_CHANNEL_RECOVERY,
 };
 
 /* Time Unit */
@@ -212,7 +241,22 @@ enum ipc_hp_identifier {
  * @buf_size:			Buffer size (in bytes) for preallocated
  *				buffers (for DL pipes)
  * @nr_of_queued_entries:	Aueued number of entries
+ * @nr_of_aborted_entries:	Number of TDs returned by CP with
+ *				IPC_MEM_TD_CS_ABORT
+ * @dl_frame:			DL frame in reassembly, the following TDs are
+ *				chained in its frag_list
+ * @dl_frame_last:		Last skb in the frag_list of dl_frame
+ * @dl_reserve:			Premapped DL buffers used when the refill
+ *				allocation fails
+ * @nr_of_dl_reserve:		Number of buffers in dl_reserve
+ * @nr_of_dl_reserve_used:	Number of TDs prepared from dl_reserve
+ * @nr_of_dl_shortfall:		Number of DL refills which left the ring
+ *				below max_nr_of_queued_entries
+ * @dl_shortfall_max:		Largest number of TDs missing after a DL
+ *				refill
  * @is_open:			Check for open pipe status
+ * @dl_frame_discard:		The TDs up to the end of the current DL frame
+ *				are dropped
  */
 struct ipc_pipe {
 	struct ipc_protocol_td *tdr_start;
@@ -231,7 +275,16 @@ struct ipc_pipe {
 	u32 td_tag;
 	u32 buf_size;
 	u16 nr_of_queued_entries;
+	u32 nr_of_aborted_entries;
+	struct sk_buff *dl_frame;
+	struct sk_buff *dl_frame_last;
+	struct sk_buff *dl_reserve[IPC_MEM_DL_RESERVE_SIZE];
+	u32 nr_of_dl_reserve;
+	u32 nr_of_dl_reserve_used;
+	u32 nr_of_dl_shortfall;
+	u32 dl_shortfall_max;
 	u8 is_open : 1;
+	u8 dl_frame_discard : 1;
 };
 
 /**
@@ -248,6 +301,8 @@ struct ipc_pipe {
  * @net_err_count:	Number of downlink errors returned by ipc_wwan_receive
  *			interface at the entry point of the IP stack.
  * @state:		Free, reserved or busy (in use).
+ * @startup_open:	The pipes were opened at the start of the runtime phase
+ *			and no user has claimed the channel yet.
  * @ul_sem:		Needed for the blocking write or uplink transfer.
  * @ul_list:		Uplink accumulator which is filled by the uplink
  *			char app or IP stack. The socket buffer pointer are
@@ -263,6 +318,7 @@ struct ipc_mem_channel {
 	int vlan_id;
 	u32 net_err_count;
 	enum ipc_channel_state state;
+	bool startup_open;
 	struct completion ul_sem;
 	struct sk_buff_head ul_list;
 };
@@ -315,6 +371,8 @@ enum ipc_phase {
  * @mbim:			IPC MBIM data structure pointer
  * @pcie:			IPC PCIe
  * @dev:			Pointer to device structure
+ * @instance:			Modem instance number, used for the char
+ *				device names
  * @flash_channel_id:		Reserved channel id for flashing to RAM.
  * @ipc_requested_state:	Expected IPC state on CP.
  * @channels:			Channel list with UL/DL pipe pairs.
@@ -323,8 +381,10 @@ enum ipc_phase {
  * @startup_timer:		startup timer for NAND support.
  * @hrtimer_period:		Hr timer period
  * @tdupdate_timer:		Delay the TD update doorbell.
+ * @td_update_usec:		Doorbell coalescing window of tdupdate_timer
  * @fast_update_timer:		forced head pointer update delay timer.
  * @td_alloc_timer:		Timer for DL pipe TD allocation retry
+ * @td_alloc_backoff_us:	Next period of td_alloc_timer in usec
  * @rom_exit_code:		Mapped boot rom exit code.
  * @enter_runtime:		1 means the transition to runtime phase was
  *				executed.
@@ -341,12 +401,13 @@ enum ipc_phase {
  * @run_state_worker:		Pointer to worker component for device
  *				setup operations to be called when modem
  *				reaches RUN state
- * @ev_irq_pending:		0 means inform the IPC tasklet to
- *				process the irq actions.
+ * @recovery_worker:		Worker to reset the IPC state after a modem
+ *				crash while keeping the net and char devices
+ * @dl_budget_exhausted:	Number of irq runs which stopped at
+ *				IMEM_DL_TD_BUDGET
+ * @dl_budget_next:		Channel index the next irq run starts the
+ *				DL processing at
  * @td_update_timer_suspended:	if true then td update timer suspend
- * @ev_sio_write_pending:	0 means inform the IPC tasklet to pass
- *				the accumulated uplink buffers to CP.
- * @ev_mux_net_transmit_pending:0 means inform the IPC tasklet to pass
  * @reset_det_n:		Reset detect flag
  * @pcie_wake_n:		Pcie wake flag
  */
@@ -361,6 +422,7 @@ struct iosm_imem {
 	struct iosm_sio *mbim;
 	struct iosm_pcie *pcie;
 	struct device *dev;
+	int instance;
 	int flash_channel_id;
 	enum ipc_mem_device_ipc_state ipc_requested_state;
 	struct ipc_mem_channel channels[IPC_MEM_MAX_CHANNELS];
@@ -369,8 +431,10 @@ struct iosm_imem {
 	struct hrtimer startup_timer;
 	ktime_t hrtimer_period;
 	struct hrtimer tdupdate_timer;
+	u32 td_update_usec;
 	struct hrtimer fast_update_timer;
 	struct hrtimer td_alloc_timer;
+	u32 td_alloc_backoff_us;
 	enum rom_exit_code rom_exit_code;
 	u32 enter_runtime;
 	struct completion ul_pend_sem;
@@ -382,10 +446,10 @@ struct iosm_imem {
 	int cp_version;
 	int device_sleep;
 	struct work_struct run_state_worker;
-	u8 ev_irq_pending[IPC_IRQ_VECTORS];
+	struct work_struct recovery_worker;
+	u32 dl_budget_exhausted;
+	u32 dl_budget_next;
 	u8 td_update_timer_suspended : 1;
-	u8 ev_sio_write_pending : 1;
-	u8 ev_mux_net_transmit_pending : 1;
 	u8 reset_det_n : 1;
 	u8 pcie_wake_n : 1;
 };
@@ -485,12 +549,59 @@ int imem_channel_alloc(struct iosm_imem *ipc_imem, int index,
 struct ipc_mem_channel *imem_channel_open(struct iosm_imem *ipc_imem,
 					  int channel_id, u32 db_id);
 
+/**
+ * imem_channels_open - Establish the pipes of several channels at once. The
+ *			OPEN_PIPE messages of all UL and DL pipes are queued
+ *			in the message ring behind a single doorbell, so the
+ *			set is opened in one round trip to CP.
+ * @ipc_imem:		Pointer to imem data-struct
+ * @channel_ids:	Channel IDs returned during alloc.
+ * @nr:			Number of entries in @channel_ids
+ * @db_id:		Doorbell ID for trigger identifier.
+ *
+ * Channels which could not be opened are released again.
+ *
+ * Returns: 0 if all channels are active, -EINVAL for an invalid channel ID,
+ *	    -ENOMEM or -EIO if a channel could not be opened.
+ */
+int imem_channels_open(struct iosm_imem *ipc_imem, const int *channel_ids,
+		       int nr, u32 db_id);
+
+/**
+ * imem_channels_startup_open - Open the pipes of the channels needed at
+ *				the start of the runtime phase, i.e. the
+ *				MUX channel, in one message round trip.
+ * @ipc_imem:		Pointer to imem data-struct
+ */
+void imem_channels_startup_open(struct iosm_imem *ipc_imem);
+
+/**
+ * imem_channel_startup_claim - Hand a channel opened by
+ *				imem_channels_startup_open() to its user.
+ * @ipc_imem:		Pointer to imem data-struct
+ * @index:		Channel index
+ * @ctype:		Channel type
+ *
+ * Returns: Channel ID or -1 if the channel is not open and unclaimed.
+ */
+int imem_channel_startup_claim(struct iosm_imem *ipc_imem, int index,
+			       enum ipc_ctype ctype);
+
 /**
  * imem_td_update_timer_start - Starts the TD Update Timer if not running.
  * @ipc_imem:	Pointer to imem data-struct
  */
 void imem_td_update_timer_start(struct iosm_imem *ipc_imem);
 
+/**
+ * imem_td_update_window_set - Set the coalescing window of the TD update
+ *			       doorbell.
+ * @ipc_imem:	Pointer to imem data-struct
+ * @usec:	Window in usec, 0 restores the default. The value is clamped
+ *		to TD_UPDATE_MIN_TIMEOUT_USEC..TD_UPDATE_DEFAULT_TIMEOUT_USEC.
+ */
+void imem_td_update_window_set(struct iosm_imem *ipc_imem, u32 usec);
+
 /**
  * imem_ul_write_td - Pass the channel UL list to protocol layer for TD
  *		      preparation and sending them to the device.
@@ -554,6 +665,16 @@ void imem_pipe_cleanup(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe);
  */
 void imem_pipe_close(struct iosm_imem *ipc_imem, struct ipc_pipe *pipe);
 
+/**
+ * imem_channel_pipes_close - Abort the UL and DL pipe of a channel, take
+ *			      back the TDs returned by CP and close the
+ *			      pipes. The channel is set to CLOSING.
+ * @ipc_imem:	Pointer to imem data-struct
+ * @channel:	Channel of the pipes
+ */
+void imem_channel_pipes_close(struct iosm_imem *ipc_imem,
+			      struct ipc_mem_channel *channel);
+
 /**
  * imem_ap_phase_update - Get the CP execution state
  *			  and map it to the AP phase.
@@ -578,6 +699,8 @@ const char *ipc_ap_phase_get_string(enum ipc_phase phase);
  * @reset_enable:	0 = out-of-band, 1 = in-band-crash notification
  * @atomic_ctx:		if disabled call in tasklet context
  *
+ * Outside of the tasklet the message is queued without waiting for the
+ * response of CP, a failure is only logged.
  */
 void imem_msg_send_feature_set(struct iosm_imem *ipc_imem,
 			       unsigned int reset_enable, bool atomic_ctx);
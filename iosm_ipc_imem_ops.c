@@ -25,7 +25,7 @@ int imem_sys_wwan_open(struct iosm_imem *ipc_imem, int vlan_id)
 	}
 
 	/* check for the vlan tag
-	 * if tag 1 to 8 then create IP MUX channel sessions.
+	 * if tag 1 to nr_sessions then create IP MUX channel sessions.
 	 * if tag 257 to 512 then create dss channel.
 	 * To start MUX session from 0 as vlan tag would start from 1
 	 * so map it to if_id = vlan_id - 1
@@ -55,26 +55,14 @@ void imem_sys_wwan_close(struct iosm_imem *ipc_imem, int vlan_id,
 		imem_channel_close(ipc_imem, channel_id);
 }
 
-/* Tasklet call to do uplink transfer. */
-static int imem_tq_sio_write(struct iosm_imem *ipc_imem, int arg, void *msg,
-			     size_t size)
-{
-	ipc_imem->ev_sio_write_pending = false;
-	imem_ul_send(ipc_imem);
-
-	return 0;
-}
-
-/* Through tasklet to do sio write. */
+/* Through tasklet to do sio write. A write which is already pending
+ * takes the new buffers along.
+ */
 static bool imem_call_sio_write(struct iosm_imem *ipc_imem)
 {
-	if (ipc_imem->ev_sio_write_pending)
-		return false;
-
-	ipc_imem->ev_sio_write_pending = true;
+	ipc_task_queue_send_event(ipc_imem, IPC_TASK_EV_SIO_WRITE);
 
-	return (!ipc_task_queue_send_task(ipc_imem, imem_tq_sio_write, 0, NULL,
-					  0, false));
+	return true;
 }
 
 /* Add skb to the ul list */
@@ -123,6 +111,10 @@ int imem_sys_wwan_transmit(struct iosm_imem *ipc_imem, int vlan_id,
 		return -EBUSY;
 	}
 
+	/* The MUX sessions account their UL activity in the codec. */
+	if (vlan_id > 256)
+		ipc_pcie_pm_activity(ipc_imem->pcie);
+
 	if (ipc_imem->channels[channel_id].ctype == IPC_CTYPE_WWAN) {
 		if (vlan_id > 0 &&
 		    vlan_id <= ipc_mux_get_max_sessions(ipc_imem->mux))
@@ -146,6 +138,7 @@ void wwan_channel_init(struct iosm_imem *ipc_imem, int total_sessions,
 		       enum ipc_mux_protocol mux_type)
 {
 	struct ipc_chnl_cfg chnl_cfg = { 0 };
+	int index, ret;
 
 	ipc_imem->cp_version = ipc_mmio_get_cp_version(ipc_imem->mmio);
 
@@ -155,11 +148,24 @@ void wwan_channel_init(struct iosm_imem *ipc_imem, int total_sessions,
 		return;
 	}
 
-	while (ipc_imem->nr_of_channels < IPC_MEM_MAX_CHANNELS &&
-	       !ipc_chnl_cfg_get(&chnl_cfg, ipc_imem->nr_of_channels)) {
+	for (index = ipc_imem->nr_of_channels;
+	     ipc_imem->nr_of_channels < IPC_MEM_MAX_CHANNELS; index++) {
+		ret = ipc_chnl_cfg_get(&chnl_cfg, index);
+
+		/* Skip the channels disabled by module parameter. */
+		if (ret == -ENODEV)
+			continue;
+
+		if (ret)
+			break;
+
 		imem_channel_init(ipc_imem, IPC_CTYPE_WWAN, chnl_cfg,
 				  IRQ_MOD_OFF);
 	}
+
+	/* The MUX pipes are open before the net devices can be used. */
+	imem_channels_startup_open(ipc_imem);
+
 	/* WWAN registration. */
 	ipc_imem->wwan = ipc_wwan_init(ipc_imem, ipc_imem->dev, total_sessions);
 	if (!ipc_imem->wwan)
@@ -455,8 +461,8 @@ void imem_sys_sio_close(struct iosm_sio *ipc_sio)
 	/* If there are any pending TDs then wait for Timeout/Completion before
 	 * closing pipe.
 	 */
-	ipc_protocol_get_head_tail_index(ipc_imem->ipc_protocol,
-					 &channel->dl_pipe, NULL, &tail);
+	tail = ipc_protocol_read_tail_index(ipc_imem->ipc_protocol,
+					   &channel->dl_pipe);
 
 	if (tail != channel->dl_pipe.old_tail) {
 		ipc_imem->app_notify_dl_pend = 1;
@@ -495,8 +501,7 @@ void imem_sys_sio_close(struct iosm_sio *ipc_sio)
 		imem_pipe_cleanup(ipc_imem, &channel->ul_pipe);
 		imem_pipe_cleanup(ipc_imem, &channel->dl_pipe);
 	} else {
-		imem_pipe_close(ipc_imem, &channel->ul_pipe);
-		imem_pipe_close(ipc_imem, &channel->dl_pipe);
+		imem_channel_pipes_close(ipc_imem, channel);
 	}
 
 	imem_channel_free(channel);
@@ -512,6 +517,9 @@ struct ipc_mem_channel *imem_sys_mbim_open(struct iosm_imem *ipc_imem)
 	int ch_id;
 	struct ipc_mem_channel *channel;
 
+	/* Wake a runtime suspended modem for the control channel. */
+	ipc_pcie_pm_wake(ipc_imem->pcie);
+
 	/* The MBIM interface is only supported in the runtime phase. */
 	if (imem_ap_phase_update(ipc_imem) != IPC_P_RUN) {
 		dev_err(ipc_imem->dev, "MBIM open refused, phase %s",
@@ -545,6 +553,9 @@ struct ipc_mem_channel *imem_sys_sio_open(struct iosm_imem *ipc_imem)
 	int channel_id;
 	struct ipc_mem_channel *channel;
 
+	/* Wake a runtime suspended modem for the control channel. */
+	ipc_pcie_pm_wake(ipc_imem->pcie);
+
 	phase = imem_ap_phase_update(ipc_imem);
 
 	/* The control link to CP is only supported in the power off, psi or
@@ -694,6 +705,8 @@ int imem_sys_sio_write(struct iosm_sio *ipc_sio,
 	struct sk_buff *skb;
 	int ret = -1;
 
+	ipc_pcie_pm_activity(ipc_imem->pcie);
+
 	set_bit(WRITE_IN_USE, &ipc_sio->flag);
 	/* Applying memory barrier so that ipc_sio->flag is updated
 	 * before being read
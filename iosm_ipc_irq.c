@@ -52,8 +52,10 @@ void ipc_release_irq(struct iosm_pcie *ipc_pcie)
 	struct pci_dev *pdev = ipc_pcie->pci;
 
 	if (pdev->msi_enabled) {
-		while (--ipc_pcie->nvec >= 0)
+		while (--ipc_pcie->nvec >= 0) {
+			irq_set_affinity_hint(pdev->irq + ipc_pcie->nvec, NULL);
 			free_irq(pdev->irq + ipc_pcie->nvec, ipc_pcie);
+		}
 	}
 	pci_free_irq_vectors(pdev);
 }
@@ -61,6 +63,7 @@ void ipc_release_irq(struct iosm_pcie *ipc_pcie)
 int ipc_acquire_irq(struct iosm_pcie *ipc_pcie)
 {
 	struct pci_dev *pdev = ipc_pcie->pci;
+	int node = dev_to_node(ipc_pcie->dev);
 	int i, rc = -1;
 
 	ipc_pcie->nvec = pci_alloc_irq_vectors(pdev, IPC_MSI_VECTORS,
@@ -82,6 +85,13 @@ int ipc_acquire_irq(struct iosm_pcie *ipc_pcie)
 			ipc_release_irq(ipc_pcie);
 			goto error;
 		}
+
+		/* Serve the irq thread and so the IPC tasklet scheduled from
+		 * it on the CPUs of the device memory node.
+		 */
+		if (node != NUMA_NO_NODE)
+			irq_set_affinity_hint(pdev->irq + i,
+					      cpumask_of_node(node));
 	}
 
 error:
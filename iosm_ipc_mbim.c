@@ -13,9 +13,6 @@
 #define IOCTL_WDM_MAX_COMMAND _IOR('H', 0xA0, __u16)
 #define WDM_MAX_SIZE 4096
 
-static struct mutex mbim_floc;		/* Mutex Lock for mbim read */
-static struct mutex mbim_floc_wr;	/* Mutex Lock for mbim write */
-
 /* MBIM IOCTL for configuring max MBIM packet size. */
 static long ipc_mbim_fop_unlocked_ioctl(struct file *filp, unsigned int cmd,
 					unsigned long arg)
@@ -57,13 +54,16 @@ static int ipc_mbim_fop_open(struct inode *inode, struct file *filp)
 		return -EIO;
 	}
 
-	mutex_lock(&mbim_floc);
+	/* The open file keeps the instance and its locks alive. */
+	kref_get(&ipc_mbim->kref);
+
+	mutex_lock(&ipc_mbim->floc);
 
 	inode->i_private = mbim_op;
 	ipc_mbim->sio_fop = mbim_op;
 	mbim_op->sio_dev = ipc_mbim;
 
-	mutex_unlock(&mbim_floc);
+	mutex_unlock(&ipc_mbim->floc);
 	return 0;
 }
 
@@ -71,15 +71,18 @@ static int ipc_mbim_fop_open(struct inode *inode, struct file *filp)
 static int ipc_mbim_fop_release(struct inode *inode, struct file *filp)
 {
 	struct iosm_sio_open_file *mbim_op = inode->i_private;
+	struct iosm_sio *ipc_mbim = mbim_op->sio_dev;
 
-	mutex_lock(&mbim_floc);
-	if (mbim_op->sio_dev) {
-		clear_bit(IS_OPEN, &mbim_op->sio_dev->flag);
-		imem_sys_sio_close(mbim_op->sio_dev);
-		mbim_op->sio_dev->sio_fop = NULL;
+	mutex_lock(&ipc_mbim->floc);
+	if (!test_bit(IS_DEINIT, &ipc_mbim->flag)) {
+		clear_bit(IS_OPEN, &ipc_mbim->flag);
+		imem_sys_sio_close(ipc_mbim);
+		ipc_mbim->sio_fop = NULL;
 	}
 	kfree(mbim_op);
-	mutex_unlock(&mbim_floc);
+	mutex_unlock(&ipc_mbim->floc);
+
+	ipc_sio_put(ipc_mbim);
 	return 0;
 }
 
@@ -98,15 +101,15 @@ static ssize_t ipc_mbim_fop_read(struct file *filp, char __user *buf,
 		goto err;
 	}
 
-	mutex_lock(&mbim_floc);
+	ipc_mbim = mbim_op->sio_dev;
+
+	mutex_lock(&ipc_mbim->floc);
 
-	if (!mbim_op->sio_dev) {
+	if (test_bit(IS_DEINIT, &ipc_mbim->flag)) {
 		ret_err = -EIO;
 		goto err_free_lock;
 	}
 
-	ipc_mbim = mbim_op->sio_dev;
-
 	if (!(filp->f_flags & O_NONBLOCK))
 		set_bit(IS_BLOCKING, &ipc_mbim->flag);
 
@@ -136,11 +139,11 @@ static ssize_t ipc_mbim_fop_read(struct file *filp, char __user *buf,
 	}
 
 	read_byt = imem_sys_sio_read(ipc_mbim, buf, size, skb);
-	mutex_unlock(&mbim_floc);
+	mutex_unlock(&ipc_mbim->floc);
 	return read_byt;
 
 err_free_lock:
-	mutex_unlock(&mbim_floc);
+	mutex_unlock(&ipc_mbim->floc);
 err:
 	return ret_err;
 }
@@ -160,15 +163,15 @@ static ssize_t ipc_mbim_fop_write(struct file *filp, const char __user *buf,
 		goto err;
 	}
 
-	mutex_lock(&mbim_floc_wr);
+	ipc_mbim = mbim_op->sio_dev;
+
+	mutex_lock(&ipc_mbim->floc_wr);
 
-	if (!mbim_op->sio_dev) {
+	if (test_bit(IS_DEINIT, &ipc_mbim->flag)) {
 		ret_err = -EIO;
 		goto err_free_lock;
 	}
 
-	ipc_mbim = mbim_op->sio_dev;
-
 	is_blocking = !(filp->f_flags & O_NONBLOCK);
 
 	if (test_bit(WRITE_IN_USE, &ipc_mbim->flag)) {
@@ -177,11 +180,11 @@ static ssize_t ipc_mbim_fop_write(struct file *filp, const char __user *buf,
 	}
 	write_byt = imem_sys_sio_write(ipc_mbim, buf, size, is_blocking);
 
-	mutex_unlock(&mbim_floc_wr);
+	mutex_unlock(&ipc_mbim->floc_wr);
 	return write_byt;
 
 err_free_lock:
-	mutex_unlock(&mbim_floc_wr);
+	mutex_unlock(&ipc_mbim->floc_wr);
 err:
 	return ret_err;
 }
@@ -229,8 +232,9 @@ struct iosm_sio *ipc_mbim_init(struct iosm_imem *ipc_imem, const char *name)
 
 	ipc_mbim->wmaxcommand = WDM_MAX_SIZE;
 
-	mutex_init(&mbim_floc);
-	mutex_init(&mbim_floc_wr);
+	mutex_init(&ipc_mbim->floc);
+	mutex_init(&ipc_mbim->floc_wr);
+	kref_init(&ipc_mbim->kref);
 	init_completion(&ipc_mbim->read_sem);
 
 	skb_queue_head_init(&ipc_mbim->rx_list);
@@ -269,18 +273,17 @@ void ipc_mbim_deinit(struct iosm_sio *ipc_mbim)
 		complete(&ipc_mbim->channel->ul_sem);
 	}
 
-	mutex_lock(&mbim_floc);
-	mutex_lock(&mbim_floc_wr);
+	mutex_lock(&ipc_mbim->floc);
+	mutex_lock(&ipc_mbim->floc_wr);
 
 	ipc_pcie_kfree_skb(ipc_mbim->pcie, ipc_mbim->rx_pending_buf);
 	ipc_mbim->rx_pending_buf = NULL;
 	skb_queue_purge(&ipc_mbim->rx_list);
 
-	if (ipc_mbim->sio_fop)
-		ipc_mbim->sio_fop->sio_dev = NULL;
+	ipc_mbim->sio_fop = NULL;
 
-	mutex_unlock(&mbim_floc_wr);
-	mutex_unlock(&mbim_floc);
+	mutex_unlock(&ipc_mbim->floc_wr);
+	mutex_unlock(&ipc_mbim->floc);
 
-	kfree(ipc_mbim);
+	ipc_sio_put(ipc_mbim);
 }
@@ -3,13 +3,27 @@
  * Copyright (C) 2020 Intel Corporation.
  */
 
+#include <linux/nospec.h>
+
 #include "iosm_ipc_mux_codec.h"
+#include "iosm_ipc_task_queue.h"
 
 /* At the begin of the runtime phase the IP MUX channel shall created. */
 static int mux_channel_create(struct iosm_mux *ipc_mux)
 {
 	int channel_id;
 
+	/* The MUX channel is normally opened at the start of the runtime
+	 * phase.
+	 */
+	channel_id = imem_channel_startup_claim(ipc_mux->imem,
+						ipc_mux->instance_id,
+						IPC_CTYPE_WWAN);
+	if (channel_id >= 0) {
+		ipc_mux->channel = &ipc_mux->imem->channels[channel_id];
+		goto channel_active;
+	}
+
 	channel_id = imem_channel_alloc(ipc_mux->imem, ipc_mux->instance_id,
 					IPC_CTYPE_WWAN);
 
@@ -32,6 +46,7 @@ static int mux_channel_create(struct iosm_mux *ipc_mux)
 		return -ENODEV; /* MUX channel is not available. */
 	}
 
+channel_active:
 	/* Define the MUX active state properties. */
 	ipc_mux->state = MUX_S_ACTIVE;
 	ipc_mux->event = MUX_E_NO_ORDERS;
@@ -40,94 +55,155 @@ no_channel:
 	return channel_id;
 }
 
-/* Reset the session/if id state. */
-static void mux_session_free(struct iosm_mux *ipc_mux, int if_id)
+/* Reset the session/if id state and take it out of the UL encoder list. */
+static void mux_session_free(struct iosm_mux *ipc_mux,
+			     struct mux_session *session)
+{
+	spin_lock_bh(&ipc_mux->session_lock);
+	session->wwan = NULL;
+	list_del_init(&session->active_node);
+	spin_unlock_bh(&ipc_mux->session_lock);
+}
+
+/* Give up a session open and tell user space about it. */
+static void mux_session_open_fail(struct iosm_mux *ipc_mux,
+				  struct mux_session *session, int if_id)
 {
-	struct mux_session *if_entry;
+	session->open_pending = false;
+	mux_session_free(ipc_mux, session);
+
+	/* Release the TX queue, the transmit drops the packets of the VID
+	 * until it is added again.
+	 */
+	ipc_wwan_tx_flowctrl(ipc_mux->wwan, if_id, false);
+	ipc_uevent_send(ipc_mux->dev, UEVENT_MUX_SESSION_FAILED);
+}
+
+/* Bring up the session with the OPEN_SESSION_RESP of CP. */
+static void mux_session_open_done(struct iosm_mux *ipc_mux, int if_id,
+				  union mux_cmd_param *param)
+{
+	struct mux_session *session = ipc_mux_session_get(ipc_mux, if_id);
+	struct mux_cmd_open_session_resp *resp;
+
+	if (!session || !session->open_pending)
+		return;
+
+	session->open_pending = false;
+
+	if (!param) {
+		dev_err(ipc_mux->dev, "if_id %d: no OPEN_SESSION_RESP", if_id);
+		goto open_failed;
+	}
 
-	if_entry = &ipc_mux->session[if_id];
-	/* Reset the session state. */
-	if_entry->wwan = NULL;
+	resp = &param->open_session_resp;
+	if (resp->response != MUX_CMD_RESP_SUCCESS) {
+		dev_err(ipc_mux->dev,
+			"if_id %d,session open failed,response=%d", if_id,
+			(int)resp->response);
+		goto open_failed;
+	}
+
+	session->dl_head_pad_len = IPC_MEM_DL_ETH_OFFSET;
+	session->ul_head_pad_len = resp->ul_head_pad_len;
+	session->ipv4v6_hints = resp->ipv4v6_hints;
+
+	/* Reset the flow ctrl stats of the session */
+	session->flow_ctl_en_cnt = 0;
+	session->flow_ctl_dis_cnt = 0;
+	session->ul_flow_credits = 0;
+	session->net_tx_stop = false;
+	session->flow_ctl_mask = 0;
+
+	/* Hand the session to the UL encoder. A reopen after a modem crash
+	 * finds it already in the list.
+	 */
+	spin_lock_bh(&ipc_mux->session_lock);
+	session->wwan = ipc_mux->wwan;
+	if (list_empty(&session->active_node))
+		list_add_tail(&session->active_node,
+			      &ipc_mux->active_sessions);
+	spin_unlock_bh(&ipc_mux->session_lock);
+
+	/* The session is up, let the net stack send. */
+	mux_netif_tx_flowctrl(session, if_id, false);
+	return;
+
+open_failed:
+	mux_session_open_fail(ipc_mux, session, if_id);
 }
 
-/* Create and send the session open command. */
-static struct mux_cmd_open_session_resp *
-mux_session_open_send(struct iosm_mux *ipc_mux, int if_id)
+/* Send the session open command. The response is passed to
+ * mux_session_open_done().
+ */
+static int mux_tq_session_open(struct iosm_imem *ipc_imem, int arg, void *msg,
+			       size_t size)
 {
-	struct mux_cmd_open_session_resp *open_session_resp;
-	struct mux_acb *acb = &ipc_mux->acb;
+	struct iosm_mux *ipc_mux = ipc_imem->mux;
+	struct mux_session *session;
 	union mux_cmd_param param;
 
+	if (!ipc_mux)
+		return -1;
+
+	session = ipc_mux_session_get(ipc_mux, arg);
+	if (!session || !session->open_pending)
+		return -1;
+
+	if (ipc_mux->state != MUX_S_ACTIVE) {
+		mux_session_open_fail(ipc_mux, session, arg);
+		return -1;
+	}
+
 	/* open_session commands to one ACB and start transmission. */
 	param.open_session.flow_ctrl = 0;
 	param.open_session.reserved = 0;
-	param.open_session.ipv4v6_hints = 0;
+	param.open_session.ipv4v6_hints = 1;
 	param.open_session.reserved2 = 0;
 	param.open_session.dl_head_pad_len = IPC_MEM_DL_ETH_OFFSET;
 
-	/* Finish and transfer ACB. The user thread is suspended.
-	 * It is a blocking function call, until CP responds or timeout.
-	 */
-	acb->wanted_response = MUX_CMD_OPEN_SESSION_RESP;
-	if (mux_dl_acb_send_cmds(ipc_mux, MUX_CMD_OPEN_SESSION, if_id, 0,
-				 &param, sizeof(param.open_session), true,
-				 false) ||
-	    acb->got_response != MUX_CMD_OPEN_SESSION_RESP) {
+	if (mux_dl_acb_send_cmds(ipc_mux, MUX_CMD_OPEN_SESSION, arg, 0,
+				 &param, sizeof(param.open_session), false,
+				 mux_session_open_done)) {
 		dev_err(ipc_mux->dev, "if_id %d: OPEN_SESSION send failed",
-			if_id);
-		return NULL;
-	}
-
-	open_session_resp = &ipc_mux->acb.got_param.open_session_resp;
-	if (open_session_resp->response != MUX_CMD_RESP_SUCCESS) {
-		dev_err(ipc_mux->dev,
-			"if_id %d,session open failed,response=%d", if_id,
-			(int)open_session_resp->response);
-		return NULL;
+			arg);
+		mux_session_open_fail(ipc_mux, session, arg);
+		return -1;
 	}
 
-	return open_session_resp;
+	return 0;
 }
 
-/* Open the first IP session. */
+/* Request the open of an IP session. */
 static bool mux_session_open(struct iosm_mux *ipc_mux,
 			     struct mux_session_open *session_open)
 {
-	struct mux_cmd_open_session_resp *open_session_resp;
+	struct mux_session *session;
 	int if_id;
 
 	/* Search for a free session interface id. */
 	if_id = session_open->if_id;
-	if (if_id < 0 || if_id >= ipc_mux->nr_sessions) {
+	session = ipc_mux_session_get(ipc_mux, if_id);
+	if (!session) {
 		dev_err(ipc_mux->dev, "invalid interface id=%d", if_id);
 		return false;
 	}
 
-	/* Create and send the session open command.
-	 * It is a blocking function call, until CP responds or timeout.
+	/* Hold the TX queue of the session until CP has opened it. */
+	ipc_wwan_tx_flowctrl(ipc_mux->wwan, if_id, true);
+
+	/* The session state is only changed by the IPC tasklet, which also
+	 * decodes the response. So the open does not wait for CP here.
 	 */
-	open_session_resp = mux_session_open_send(ipc_mux, if_id);
-	if (!open_session_resp) {
-		mux_session_free(ipc_mux, if_id);
+	session->open_pending = true;
+	if (ipc_task_queue_send_task(ipc_mux->imem, mux_tq_session_open,
+				     if_id, NULL, 0, false)) {
+		session->open_pending = false;
+		ipc_wwan_tx_flowctrl(ipc_mux->wwan, if_id, false);
 		session_open->if_id = -1;
 		return false;
 	}
 
-	/* Initialize the uplink skb accumulator. */
-	skb_queue_head_init(&ipc_mux->session[if_id].ul_list);
-
-	ipc_mux->session[if_id].dl_head_pad_len = IPC_MEM_DL_ETH_OFFSET;
-	ipc_mux->session[if_id].ul_head_pad_len =
-		open_session_resp->ul_head_pad_len;
-	ipc_mux->session[if_id].wwan = ipc_mux->wwan;
-
-	/* Reset the flow ctrl stats of the session */
-	ipc_mux->session[if_id].flow_ctl_en_cnt = 0;
-	ipc_mux->session[if_id].flow_ctl_dis_cnt = 0;
-	ipc_mux->session[if_id].ul_flow_credits = 0;
-	ipc_mux->session[if_id].net_tx_stop = false;
-	ipc_mux->session[if_id].flow_ctl_mask = 0;
-
 	/* Save and return the assigned if id. */
 	session_open->if_id = if_id;
 
@@ -135,13 +211,54 @@ static bool mux_session_open(struct iosm_mux *ipc_mux,
 }
 
 /* Free pending session UL packet. */
-static void mux_session_reset(struct iosm_mux *ipc_mux, int if_id)
+static void mux_session_reset(struct iosm_mux *ipc_mux,
+			      struct mux_session *session)
 {
 	/* Reset the session/if id state. */
-	mux_session_free(ipc_mux, if_id);
+	mux_session_free(ipc_mux, session);
 
 	/* Empty the uplink skb accumulator. */
-	skb_queue_purge(&ipc_mux->session[if_id].ul_list);
+	skb_queue_purge(&session->ul_list);
+}
+
+/* Release the session and send the session close command. The
+ * CLOSE_SESSION_RESP is not waited for.
+ */
+static int mux_tq_session_close(struct iosm_imem *ipc_imem, int arg,
+				void *msg, size_t size)
+{
+	struct iosm_mux *ipc_mux = ipc_imem->mux;
+	struct mux_session *session;
+
+	if (!ipc_mux)
+		return -1;
+
+	session = ipc_mux_session_get(ipc_mux, arg);
+	if (!session)
+		return -1;
+
+	/* A late OPEN_SESSION_RESP shall not revive the session. */
+	session->open_pending = false;
+	mux_transactions_cancel(ipc_mux, arg);
+
+	/* Reset the flow ctrl stats of the session */
+	session->flow_ctl_en_cnt = 0;
+	session->flow_ctl_dis_cnt = 0;
+	session->flow_ctl_mask = 0;
+
+	mux_session_reset(ipc_mux, session);
+
+	if (ipc_mux->state != MUX_S_ACTIVE)
+		return 0;
+
+	if (mux_dl_acb_send_cmds(ipc_mux, MUX_CMD_CLOSE_SESSION, arg, 0, NULL,
+				 0, false, NULL)) {
+		dev_err(ipc_mux->dev, "if_id %d: CLOSE_SESSION send failed",
+			arg);
+		return -1;
+	}
+
+	return 0;
 }
 
 static void mux_session_close(struct iosm_mux *ipc_mux,
@@ -152,36 +269,50 @@ static void mux_session_close(struct iosm_mux *ipc_mux,
 	/* Copy the session interface id. */
 	if_id = msg->if_id;
 
-	if (if_id < 0 || if_id >= ipc_mux->nr_sessions) {
+	if (!ipc_mux_session_get(ipc_mux, if_id)) {
 		dev_err(ipc_mux->dev, "invalid session id %d", if_id);
 		return;
 	}
 
-	/* Create and send the session close command.
-	 * It is a blocking function call, until CP responds or timeout.
-	 */
-	if (mux_dl_acb_send_cmds(ipc_mux, MUX_CMD_CLOSE_SESSION, if_id, 0, NULL,
-				 0, true, false))
-		dev_err(ipc_mux->dev, "if_id %d: CLOSE_SESSION send failed",
-			if_id);
+	if (ipc_task_queue_send_task(ipc_mux->imem, mux_tq_session_close,
+				     if_id, NULL, 0, false))
+		dev_err(ipc_mux->dev, "if_id %d: session close failed", if_id);
+}
 
-	/* Reset the flow ctrl stats of the session */
-	ipc_mux->session[if_id].flow_ctl_en_cnt = 0;
-	ipc_mux->session[if_id].flow_ctl_dis_cnt = 0;
-	ipc_mux->session[if_id].flow_ctl_mask = 0;
+/* Release the sessions and drop the pending commands. The transaction table
+ * is only used by the tasklet. Running this as a synchronous task also
+ * drains the tasks queued before, e.g. by the transaction timer.
+ */
+static int mux_tq_channel_close(struct iosm_imem *ipc_imem, int arg,
+				void *msg, size_t size)
+{
+	struct iosm_mux *ipc_mux = msg;
+	struct mux_session *session;
+	int i;
+
+	/* Free pending session UL packet. */
+	for (i = 0; i < ipc_mux->nr_sessions; i++) {
+		session = smp_load_acquire(&ipc_mux->session[i]);
 
-	mux_session_reset(ipc_mux, if_id);
+		if (!session)
+			continue;
+
+		session->open_pending = false;
+
+		if (session->wwan)
+			mux_session_reset(ipc_mux, session);
+	}
+
+	mux_transactions_cancel(ipc_mux, -1);
+
+	return 0;
 }
 
 static void mux_channel_close(struct iosm_mux *ipc_mux,
 			      struct mux_channel_close *channel_close_p)
 {
-	int i;
-
-	/* Free pending session UL packet. */
-	for (i = 0; i < ipc_mux->nr_sessions; i++)
-		if (ipc_mux->session[i].wwan)
-			mux_session_reset(ipc_mux, i);
+	ipc_task_queue_send_task(ipc_mux->imem, mux_tq_channel_close, 0,
+				 ipc_mux, 0, true);
 
 	imem_channel_close(ipc_mux->imem, ipc_mux->channel_id);
 
@@ -215,22 +346,17 @@ static int mux_schedule(struct iosm_mux *ipc_mux, union mux_msg *msg)
 			/* Missing the MUX channel. */
 			return -1;
 
-		/* Disable the TD update timer and open the first IP session. */
-		imem_td_update_timer_suspend(ipc_mux->imem, true);
+		/* Open the first IP session. */
 		ipc_mux->event = MUX_E_MUX_SESSION_OPEN;
 		success = mux_session_open(ipc_mux, &msg->session_open);
-
-		imem_td_update_timer_suspend(ipc_mux->imem, false);
 		return success ? ipc_mux->channel_id : -1;
 
 	case MUX_S_ACTIVE:
 		switch (order) {
 		case MUX_E_MUX_SESSION_OPEN:
-			/* Disable the TD update timer and open a session */
-			imem_td_update_timer_suspend(ipc_mux->imem, true);
+			/* Open a session */
 			ipc_mux->event = MUX_E_MUX_SESSION_OPEN;
 			success = mux_session_open(ipc_mux, &msg->session_open);
-			imem_td_update_timer_suspend(ipc_mux->imem, false);
 			return success ? ipc_mux->channel_id : -1;
 
 		case MUX_E_MUX_SESSION_CLOSE:
@@ -258,12 +384,115 @@ static int mux_schedule(struct iosm_mux *ipc_mux, union mux_msg *msg)
 	}
 }
 
+/* One line per session: if_id, number of link status reports, age of the
+ * last report in ms, flow control enable and disable counts and the last
+ * report in hex.
+ */
+static ssize_t link_status_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+	struct mux_session *session;
+	struct iosm_mux *ipc_mux;
+	unsigned int age;
+	ssize_t len = 0;
+	int i;
+
+	if (!ipc_pcie || !ipc_pcie->imem || !ipc_pcie->imem->mux)
+		return -ENODEV;
+
+	ipc_mux = ipc_pcie->imem->mux;
+
+	spin_lock_bh(&ipc_mux->session_lock);
+
+	for (i = 0; i < ipc_mux->nr_sessions; i++) {
+		session = smp_load_acquire(&ipc_mux->session[i]);
+
+		if (!session || (!session->wwan && !session->link_status_cnt))
+			continue;
+
+		age = session->link_status_cnt ?
+		      jiffies_to_msecs(jiffies - session->link_status_time) :
+		      0;
+
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%d %u %u %u %u %*phN\n", i,
+				 session->link_status_cnt, age,
+				 session->flow_ctl_en_cnt,
+				 session->flow_ctl_dis_cnt,
+				 session->link_status_len,
+				 session->link_status);
+	}
+
+	spin_unlock_bh(&ipc_mux->session_lock);
+
+	return len;
+}
+
+static DEVICE_ATTR_RO(link_status);
+
+static ssize_t ul_capacity_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+
+	if (!ipc_pcie || !ipc_pcie->imem || !ipc_pcie->imem->mux)
+		return -ENODEV;
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n",
+			 READ_ONCE(ipc_pcie->imem->mux->ul_capacity));
+}
+
+/* The UL link capacity in kbit/s taken from the link status reports by the
+ * connection manager, 0 if unknown. The doorbell is delayed by about the
+ * time the link takes to fill one UL ADB, so a fast link gets full ADBs
+ * without waiting for the timer.
+ */
+static ssize_t ul_capacity_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+	struct iosm_mux *ipc_mux;
+	u32 kbps, usec = 0;
+
+	if (!ipc_pcie || !ipc_pcie->imem || !ipc_pcie->imem->mux)
+		return -ENODEV;
+
+	if (kstrtou32(buf, 0, &kbps))
+		return -EINVAL;
+
+	ipc_mux = ipc_pcie->imem->mux;
+	WRITE_ONCE(ipc_mux->ul_capacity, kbps);
+
+	if (kbps)
+		usec = DIV_ROUND_UP(IPC_MEM_MAX_DL_MUX_LITE_BUF_SIZE * 8000,
+				    kbps);
+
+	imem_td_update_window_set(ipc_mux->imem, usec);
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(ul_capacity);
+
+static struct attribute *mux_attrs[] = {
+	&dev_attr_link_status.attr,
+	&dev_attr_ul_capacity.attr,
+	NULL,
+};
+
+static const struct attribute_group mux_attr_group = {
+	.name = "iosm_mux",
+	.attrs = mux_attrs,
+};
+
 struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
 			  struct iosm_imem *imem)
 {
-	struct iosm_mux *ipc_mux = kzalloc(sizeof(*ipc_mux), GFP_KERNEL);
+	struct iosm_mux *ipc_mux = kzalloc_node(sizeof(*ipc_mux), GFP_KERNEL,
+						dev_to_node(imem->dev));
 	int i, ul_tds, ul_td_size;
-	struct mux_session *session;
 	struct sk_buff_head *free_list;
 	struct sk_buff *skb;
 
@@ -282,16 +511,23 @@ struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
 	ipc_mux->dev = imem->dev;
 	ipc_mux->wwan = imem->wwan;
 
-	ipc_mux->session =
-		kcalloc(ipc_mux->nr_sessions, sizeof(*session), GFP_KERNEL);
+	/* The sessions themselves are allocated on their first open. */
+	ipc_mux->session = kcalloc_node(ipc_mux->nr_sessions,
+					sizeof(*ipc_mux->session), GFP_KERNEL,
+					dev_to_node(imem->dev));
 
 	if (!ipc_mux->session) {
 		kfree(ipc_mux);
 		return NULL;
 	}
 
-	/* Get the reference to the id list. */
-	session = ipc_mux->session;
+	INIT_LIST_HEAD(&ipc_mux->active_sessions);
+	spin_lock_init(&ipc_mux->session_lock);
+
+	mux_transactions_init(ipc_mux);
+
+	ipc_task_queue_event_init(imem, IPC_TASK_EV_MUX_UL_ENCODE,
+				  mux_tq_ul_trigger_encode, 0);
 
 	/* Get the reference to the UL ADB list. */
 	free_list = &ipc_mux->ul_adb.free_list;
@@ -310,9 +546,7 @@ struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
 	ipc_mux->size_needed = 0;
 	ipc_mux->ul_data_pend_bytes = 0;
 	ipc_mux->state = MUX_S_INACTIVE;
-	ipc_mux->ev_mux_net_transmit_pending = false;
 	ipc_mux->tx_transaction_id = 0;
-	ipc_mux->rr_next_session = 0;
 	ipc_mux->event = MUX_E_INACTIVE;
 	ipc_mux->channel_id = -1;
 	ipc_mux->channel = NULL;
@@ -331,6 +565,12 @@ struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
 		skb_queue_tail(free_list, skb);
 	}
 
+	/* Export the link status of the sessions. */
+	if (sysfs_create_group(&ipc_mux->dev->kobj, &mux_attr_group))
+		dev_err(ipc_mux->dev, "link status attributes failed");
+	else
+		ipc_mux->sysfs_registered = true;
+
 	return ipc_mux;
 }
 
@@ -340,23 +580,21 @@ struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
 static void mux_restart_tx_for_all_sessions(struct iosm_mux *ipc_mux)
 {
 	struct mux_session *session;
-	int idx;
-
-	for (idx = 0; idx < ipc_mux->nr_sessions; idx++) {
-		session = &ipc_mux->session[idx];
 
-		if (!session->wwan)
-			continue;
+	spin_lock_bh(&ipc_mux->session_lock);
 
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node) {
 		/* If flow control of the session is OFF and if there was tx
 		 * stop then restart. Inform the network interface to restart
 		 * sending data.
 		 */
 		if (session->flow_ctl_mask == 0) {
 			session->net_tx_stop = false;
-			mux_netif_tx_flowctrl(session, idx, false);
+			mux_netif_tx_flowctrl(session, session->if_id, false);
 		}
 	}
+
+	spin_unlock_bh(&ipc_mux->session_lock);
 }
 
 /* Informs the network stack to stop sending further pkt for all opened
@@ -365,16 +603,13 @@ static void mux_restart_tx_for_all_sessions(struct iosm_mux *ipc_mux)
 static void mux_stop_netif_for_all_sessions(struct iosm_mux *ipc_mux)
 {
 	struct mux_session *session;
-	int idx;
-
-	for (idx = 0; idx < ipc_mux->nr_sessions; idx++) {
-		session = &ipc_mux->session[idx];
 
-		if (!session->wwan)
-			continue;
+	spin_lock_bh(&ipc_mux->session_lock);
 
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node)
 		mux_netif_tx_flowctrl(session, session->if_id, true);
-	}
+
+	spin_unlock_bh(&ipc_mux->session_lock);
 }
 
 void ipc_mux_check_n_restart_tx(struct iosm_mux *ipc_mux)
@@ -397,22 +632,53 @@ enum ipc_mux_protocol ipc_mux_get_active_protocol(struct iosm_mux *ipc_mux)
 	return ipc_mux ? ipc_mux->protocol : MUX_UNKNOWN;
 }
 
+struct mux_session *ipc_mux_session_get(struct iosm_mux *ipc_mux, int if_id)
+{
+	if (if_id < 0 || if_id >= ipc_mux->nr_sessions)
+		return NULL;
+
+	if_id = array_index_nospec(if_id, ipc_mux->nr_sessions);
+
+	/* Pairs with the release in ipc_mux_open_session(), the session is
+	 * published to the tasklet only once it is initialized.
+	 */
+	return smp_load_acquire(&ipc_mux->session[if_id]);
+}
+
 int ipc_mux_open_session(struct iosm_mux *ipc_mux, int session_nr)
 {
 	struct mux_session_open *session_open;
+	struct mux_session *session;
 	union mux_msg mux_msg;
 
+	if (session_nr < 0 || session_nr >= ipc_mux->nr_sessions)
+		return -1;
+
+	session = ipc_mux->session[session_nr];
+	if (!session) {
+		session = kzalloc_node(sizeof(*session), GFP_KERNEL,
+				       dev_to_node(ipc_mux->dev));
+		if (!session)
+			return -1;
+
+		session->if_id = session_nr;
+		skb_queue_head_init(&session->ul_list);
+		INIT_LIST_HEAD(&session->active_node);
+		smp_store_release(&ipc_mux->session[session_nr], session);
+	}
+
 	session_open = &mux_msg.session_open;
 	session_open->event = MUX_E_MUX_SESSION_OPEN;
 
 	session_open->if_id = session_nr;
-	ipc_mux->session[session_nr].flags |= IPC_MEM_WWAN_MUX;
+	session->flags |= IPC_MEM_WWAN_MUX;
 	return mux_schedule(ipc_mux, &mux_msg);
 }
 
 int ipc_mux_close_session(struct iosm_mux *ipc_mux, int session_nr)
 {
 	struct mux_session_close *session_close;
+	struct mux_session *session;
 	union mux_msg mux_msg;
 	int ret_val;
 
@@ -421,26 +687,143 @@ int ipc_mux_close_session(struct iosm_mux *ipc_mux, int session_nr)
 
 	session_close->if_id = session_nr;
 	ret_val = mux_schedule(ipc_mux, &mux_msg);
-	ipc_mux->session[session_nr].flags &= ~IPC_MEM_WWAN_MUX;
+
+	session = ipc_mux_session_get(ipc_mux, session_nr);
+	if (session)
+		session->flags &= ~IPC_MEM_WWAN_MUX;
 
 	return ret_val;
 }
 
+void ipc_mux_recovery_reset(struct iosm_mux *ipc_mux)
+{
+	struct mux_adb *ul_adb = &ipc_mux->ul_adb;
+	struct mux_session *session;
+	int i;
+
+	if (!ipc_mux->initialized)
+		return;
+
+	/* Hold the net interfaces until the sessions are reopened. */
+	mux_stop_netif_for_all_sessions(ipc_mux);
+
+	/* CP lost the pending commands. A pending session open is repeated
+	 * by ipc_mux_recovery_reopen().
+	 */
+	mux_transactions_cancel(ipc_mux, -1);
+
+	for (i = 0; i < ipc_mux->nr_sessions; i++) {
+		session = smp_load_acquire(&ipc_mux->session[i]);
+		if (session)
+			session->open_pending = false;
+	}
+
+	spin_lock_bh(&ipc_mux->session_lock);
+
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node) {
+		skb_queue_purge(&session->ul_list);
+		session->flow_ctl_mask = 0;
+		session->ul_flow_credits = 0;
+		session->net_tx_stop = true;
+	}
+
+	spin_unlock_bh(&ipc_mux->session_lock);
+
+	/* Give the partially encoded ADB back to the free list. */
+	if (ul_adb->dest_skb) {
+		skb_queue_tail(&ul_adb->free_list, ul_adb->dest_skb);
+		ul_adb->dest_skb = NULL;
+	}
+
+	if (ul_adb->qlth_skb) {
+		skb_queue_tail(&ul_adb->free_list, ul_adb->qlth_skb);
+		ul_adb->qlth_skb = NULL;
+	}
+
+	ipc_mux->ul_data_pend_bytes = 0;
+	ipc_mux->size_needed = 0;
+	ipc_mux->adb_prep_ongoing = false;
+}
+
+void ipc_mux_recovery_reopen(struct iosm_mux *ipc_mux)
+{
+	struct mux_session *session;
+	int i;
+
+	if (!ipc_mux->initialized)
+		return;
+
+	/* The MUX channel could not be reopened together with the other
+	 * channels. Let the first session open create it again.
+	 */
+	if (ipc_mux->state == MUX_S_ACTIVE &&
+	    (!ipc_mux->channel ||
+	     ipc_mux->channel->state != IMEM_CHANNEL_ACTIVE)) {
+		ipc_mux->state = MUX_S_INACTIVE;
+		ipc_mux->event = MUX_E_INACTIVE;
+		ipc_mux->channel = NULL;
+		ipc_mux->channel_id = -1;
+	}
+
+	for (i = 0; i < ipc_mux->nr_sessions; i++) {
+		session = smp_load_acquire(&ipc_mux->session[i]);
+
+		if (!session || !(session->flags & IPC_MEM_WWAN_MUX))
+			continue;
+
+		if (ipc_mux_open_session(ipc_mux, i) < 0)
+			dev_err(ipc_mux->dev, "if_id %d: reopen failed", i);
+	}
+
+	mux_restart_tx_for_all_sessions(ipc_mux);
+}
+
+/* Unhook the MUX from imem in tasklet context, so no task or event handler
+ * runs on it afterwards.
+ */
+static int mux_tq_detach(struct iosm_imem *ipc_imem, int arg, void *msg,
+			 size_t size)
+{
+	if (ipc_imem->mux == msg)
+		ipc_imem->mux = NULL;
+
+	ipc_task_queue_event_init(ipc_imem, IPC_TASK_EV_MUX_UL_ENCODE, NULL,
+				  0);
+	return 0;
+}
+
 void ipc_mux_deinit(struct iosm_mux *ipc_mux)
 {
 	struct mux_channel_close *channel_close;
 	struct sk_buff_head *free_list;
 	union mux_msg mux_msg;
 	struct sk_buff *skb;
+	int i;
 
 	if (!ipc_mux->initialized)
 		return;
+
+	/* Wait for the readers of the session table. */
+	if (ipc_mux->sysfs_registered)
+		sysfs_remove_group(&ipc_mux->dev->kobj, &mux_attr_group);
+
+	imem_td_update_window_set(ipc_mux->imem, 0);
+
 	mux_stop_netif_for_all_sessions(ipc_mux);
 
 	channel_close = &mux_msg.channel_close;
 	channel_close->event = MUX_E_MUX_CHANNEL_CLOSE;
 	mux_schedule(ipc_mux, &mux_msg);
 
+	/* The channel close drained the queued timeouts, no transaction is
+	 * left to restart the timer.
+	 */
+	hrtimer_cancel(&ipc_mux->trans_timer);
+
+	/* Later tasks and events find no MUX. */
+	ipc_task_queue_send_task(ipc_mux->imem, mux_tq_detach, 0, ipc_mux, 0,
+				 true);
+
 	/* Empty the ADB free list. */
 	free_list = &ipc_mux->ul_adb.free_list;
 
@@ -453,6 +836,9 @@ void ipc_mux_deinit(struct iosm_mux *ipc_mux)
 		ipc_mux->channel->dl_pipe.is_open = false;
 	}
 
+	for (i = 0; i < ipc_mux->nr_sessions; i++)
+		kfree(ipc_mux->session[i]);
+
 	kfree(ipc_mux->session);
 	kfree(ipc_mux);
 }
@@ -51,6 +51,14 @@
 /* command response : command processed successfully */
 #define MUX_CMD_RESP_SUCCESS 0
 
+/* Number of MUX commands which may wait for their response at a time.
+ * Must be a power of 2, the slot is indexed by the transaction id.
+ */
+#define IPC_MUX_MAX_TRANSACTIONS 16
+
+/* Number of bytes kept of the last link status report of a session. */
+#define IPC_MUX_LINK_STATUS_MAX 16
+
 /* MUX for vlan devices */
 #define IPC_MEM_WWAN_MUX BIT(0)
 
@@ -190,6 +198,13 @@ struct mux_session {
 	u32 flow_ctl_en_cnt; /* Flow control Enable cmd count */
 	u32 flow_ctl_dis_cnt; /* Flow Control Disable cmd count */
 	int ul_flow_credits; /* UL flow credits */
+	struct list_head active_node; /* Entry in the active session list */
+	unsigned long link_status_time; /* jiffies of the last link status */
+	u32 link_status_cnt; /* Number of link status reports */
+	u8 link_status_len; /* Valid bytes in link_status */
+	u8 link_status[IPC_MUX_LINK_STATUS_MAX]; /* Last link status report */
+	bool open_pending; /* Waiting for the OPEN_SESSION_RESP */
+	bool ipv4v6_hints; /* CP supports the IPv4/IPv6 hints */
 	u8 net_tx_stop : 1;
 	u8 flush : 1; /* flush net interface ? */
 };
@@ -212,16 +227,43 @@ struct mux_adb {
 struct mux_acb {
 	struct sk_buff *skb; /* Used UL skb. */
 	int if_id; /* Session id. */
-	u32 wanted_response;
-	u32 got_response;
 	u32 cmd;
-	union mux_cmd_param got_param; /* Received command/response parameter */
+};
+
+struct iosm_mux;
+
+/* Handler of a MUX command response, called in the IPC tasklet. param is
+ * NULL if CP did not respond in time.
+ */
+typedef void (*mux_transaction_done_t)(struct iosm_mux *ipc_mux, int if_id,
+				       union mux_cmd_param *param);
+
+/**
+ * struct mux_transaction - MUX command waiting for its response.
+ * @done:		Response handler or NULL
+ * @expires:		Timeout of the command in jiffies
+ * @transaction_id:	Transaction id of the command
+ * @cmd:		Command type
+ * @if_id:		Session interface id of the command
+ * @in_use:		Slot is waiting for a response
+ */
+struct mux_transaction {
+	mux_transaction_done_t done;
+	unsigned long expires;
+	u32 transaction_id;
+	u32 cmd;
+	int if_id;
+	u8 in_use : 1;
 };
 
 /**
  * struct iosm_mux - Structure of the data multiplexing over an IP channel.
  * @dev:		pointer to device structure
- * @session:		List of the MUX sessions.
+ * @session:		Table of the MUX sessions indexed by if_id, an entry
+ *			is allocated on the first open of the session.
+ * @active_sessions:	List of the open sessions walked by the UL encoder,
+ *			rotated for round robin.
+ * @session_lock:	Protects the active session list.
  * @channel:		Reference to the IP MUX channel
  * @pcie:		Pointer to iosm_pcie struct
  * @imem:		Pointer to iosm_imem
@@ -235,23 +277,27 @@ struct mux_acb {
  * @state:		States of the MUX object
  * @event:		Initiated actions to change the state of the MUX object
  * @tx_transaction_id:	Transaction id for the ACB command.
- * @rr_next_session:	Next session number for round robin.
  * @ul_adb:		State of the UL ADB/ADGH.
  * @size_needed:	Variable to store the size needed during ADB preparation
  * @ul_data_pend_bytes:	Pending UL data to be processed in bytes
  * @acb:		Temporary ACB state
+ * @trans:		Commands waiting for their response, indexed by the
+ *			transaction id.
+ * @trans_timer:	Timer to expire the unanswered commands
+ * @trans_timeouts:	Number of commands CP did not respond to
+ * @ul_capacity:	UL link capacity in kbit/s, 0 if unknown
  * @wwan_q_offset:	This will hold the offset of the given instance
  *			Useful while passing or receiving packets from
  *			wwan/imem layer.
  * @initialized:	MUX object is initialized
- * @ev_mux_net_transmit_pending:
- *			0 means inform the IPC tasklet to pass the
- *			accumulated uplink ADB to CP.
+ * @sysfs_registered:	The link status attributes are registered
  * @adb_prep_ongoing:	Flag for ADB preparation status
  */
 struct iosm_mux {
 	struct device *dev;
-	struct mux_session *session;
+	struct mux_session **session;
+	struct list_head active_sessions;
+	spinlock_t session_lock; /* Protects the active session list */
 	struct ipc_mem_channel *channel;
 	struct iosm_pcie *pcie;
 	struct iosm_imem *imem;
@@ -265,14 +311,17 @@ struct iosm_mux {
 	enum mux_state state;
 	enum mux_event event;
 	u32 tx_transaction_id;
-	int rr_next_session;
 	struct mux_adb ul_adb;
 	int size_needed;
 	long long ul_data_pend_bytes;
 	struct mux_acb acb;
+	struct mux_transaction trans[IPC_MUX_MAX_TRANSACTIONS];
+	struct hrtimer trans_timer;
+	u32 trans_timeouts;
+	u32 ul_capacity;
 	int wwan_q_offset;
 	u8 initialized : 1;
-	u8 ev_mux_net_transmit_pending : 1;
+	u8 sysfs_registered : 1;
 	u8 adb_prep_ongoing : 1;
 };
 
@@ -300,6 +349,22 @@ struct iosm_mux *mux_init(struct ipc_mux_config *mux_cfg,
  */
 void ipc_mux_deinit(struct iosm_mux *ipc_mux);
 
+/**
+ * ipc_mux_recovery_reset - Drop the UL data of all sessions and return the
+ *			    pending ADBs to the free list after a modem
+ *			    crash. The sessions and the ADB pool are kept.
+ * @ipc_mux:	Pointer to MUX data-struct
+ */
+void ipc_mux_recovery_reset(struct iosm_mux *ipc_mux);
+
+/**
+ * ipc_mux_recovery_reopen - Reopen the sessions which were active before
+ *			     the modem crash and restart the net interfaces.
+ *			     It is a blocking function call.
+ * @ipc_mux:	Pointer to MUX data-struct
+ */
+void ipc_mux_recovery_reopen(struct iosm_mux *ipc_mux);
+
 /**
  * ipc_mux_check_n_restart_tx - Checks for pending UL date bytes and then
  *				it restarts the net interface tx queue if
@@ -317,7 +382,19 @@ void ipc_mux_check_n_restart_tx(struct iosm_mux *ipc_mux);
 enum ipc_mux_protocol ipc_mux_get_active_protocol(struct iosm_mux *ipc_mux);
 
 /**
- * ipc_mux_open_session - Opens a MUX session for IP traffic.
+ * ipc_mux_session_get - Get an allocated MUX session.
+ * @ipc_mux:	Pointer to MUX data-struct
+ * @if_id:	Interface ID or session number
+ *
+ * Returns: Pointer to the session, NULL if the if_id is out of range or the
+ *	    session was never opened
+ */
+struct mux_session *ipc_mux_session_get(struct iosm_mux *ipc_mux, int if_id);
+
+/**
+ * ipc_mux_open_session - Opens a MUX session for IP traffic. The
+ *			  OPEN_SESSION command is sent asynchronously and the
+ *			  TX queue of the session is held until CP responds.
  * @ipc_mux:	Pointer to MUX data-struct
  * @session_nr:	Interface ID or session number
  *
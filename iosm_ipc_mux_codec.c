@@ -4,7 +4,6 @@
  */
 
 #include <linux/if_vlan.h>
-#include <linux/nospec.h>
 
 #include "iosm_ipc_imem_ops.h"
 #include "iosm_ipc_mux_codec.h"
@@ -17,44 +16,128 @@ static int mux_tq_cmd_send(struct iosm_imem *ipc_imem, int arg, void *msg,
 	struct iosm_mux *ipc_mux = ipc_imem->mux;
 	const struct mux_acb *acb = msg;
 
+	if (!ipc_mux) {
+		ipc_pcie_kfree_skb(ipc_imem->pcie, acb->skb);
+		return -1;
+	}
+
 	skb_queue_tail(&ipc_mux->channel->ul_list, acb->skb);
 	imem_ul_send(ipc_mux->imem);
 
 	return 0;
 }
 
-static int mux_acb_send(struct iosm_mux *ipc_mux, bool blocking)
+static int mux_acb_send(struct iosm_mux *ipc_mux)
 {
-	struct completion *completion = &ipc_mux->channel->ul_sem;
-
-	if (ipc_task_queue_send_task(ipc_mux->imem, mux_tq_cmd_send, 0,
-				     &ipc_mux->acb, sizeof(ipc_mux->acb),
-				     false)) {
+	/* Flow control ACKs are part of the packet path. */
+	if (ipc_task_queue_send_lane(ipc_mux->imem, IPC_TASK_LANE_DATA,
+				     mux_tq_cmd_send, 0, &ipc_mux->acb,
+				     sizeof(ipc_mux->acb), false)) {
 		dev_err(ipc_mux->dev, "unable to send mux command");
+		ipc_pcie_kfree_skb(ipc_mux->pcie, ipc_mux->acb.skb);
+		ipc_mux->acb.skb = NULL;
 		return -1;
 	}
 
-	/* if blocking, suspend the app and wait for irq in the flash or
-	 * crash phase. return false on timeout to indicate failure.
-	 */
-	if (blocking) {
-		u32 wait_time_milliseconds = IPC_MUX_CMD_RUN_DEFAULT_TIMEOUT;
-
-		reinit_completion(completion);
-
-		if (wait_for_completion_interruptible_timeout
-		   (completion, msecs_to_jiffies(wait_time_milliseconds)) ==
-		   0) {
-			dev_err(ipc_mux->dev, "ch[%d] timeout",
-				ipc_mux->channel_id);
-			ipc_uevent_send(ipc_mux->imem->dev, UEVENT_MDM_TIMEOUT);
-			return -ETIMEDOUT;
+	return 0;
+}
+
+/* Expire the commands CP did not respond to. */
+static int mux_tq_trans_timeout(struct iosm_imem *ipc_imem, int arg,
+				void *msg, size_t size)
+{
+	struct iosm_mux *ipc_mux = ipc_imem->mux;
+	struct mux_transaction *trans;
+	bool pending = false;
+	int i;
+
+	/* The MUX was released after the timer expired. */
+	if (!ipc_mux)
+		return 0;
+
+	for (i = 0; i < IPC_MUX_MAX_TRANSACTIONS; i++) {
+		trans = &ipc_mux->trans[i];
+
+		if (!trans->in_use)
+			continue;
+
+		if (time_before(jiffies, trans->expires)) {
+			pending = true;
+			continue;
 		}
+
+		trans->in_use = false;
+		ipc_mux->trans_timeouts++;
+
+		dev_err(ipc_mux->dev, "if_id %d: cmd %u transaction %u timeout",
+			trans->if_id, trans->cmd, trans->transaction_id);
+		ipc_uevent_send(ipc_mux->imem->dev, UEVENT_MDM_TIMEOUT);
+
+		if (trans->done)
+			trans->done(ipc_mux, trans->if_id, NULL);
 	}
 
+	if (pending)
+		hrtimer_start(&ipc_mux->trans_timer,
+			      ms_to_ktime(IPC_MUX_CMD_RUN_DEFAULT_TIMEOUT),
+			      HRTIMER_MODE_REL);
+
 	return 0;
 }
 
+static enum hrtimer_restart mux_trans_timer_cb(struct hrtimer *hr_timer)
+{
+	struct iosm_mux *ipc_mux =
+		container_of(hr_timer, struct iosm_mux, trans_timer);
+
+	ipc_task_queue_send_task(ipc_mux->imem, mux_tq_trans_timeout, 0, NULL,
+				 0, false);
+	return HRTIMER_NORESTART;
+}
+
+void mux_transactions_init(struct iosm_mux *ipc_mux)
+{
+	memset(ipc_mux->trans, 0, sizeof(ipc_mux->trans));
+	ipc_mux->trans_timeouts = 0;
+
+	hrtimer_init(&ipc_mux->trans_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ipc_mux->trans_timer.function = mux_trans_timer_cb;
+}
+
+void mux_transactions_cancel(struct iosm_mux *ipc_mux, int if_id)
+{
+	int i;
+
+	for (i = 0; i < IPC_MUX_MAX_TRANSACTIONS; i++)
+		if (if_id < 0 || ipc_mux->trans[i].if_id == if_id)
+			ipc_mux->trans[i].in_use = false;
+}
+
+/* Take the command out of the transaction table and pass the response to
+ * its handler. Returns false if no command waits for this response.
+ */
+static bool mux_transaction_complete(struct iosm_mux *ipc_mux,
+				     struct mux_lite_cmdh *cmdh)
+{
+	struct mux_transaction *trans;
+
+	trans = &ipc_mux->trans[cmdh->transaction_id &
+				(IPC_MUX_MAX_TRANSACTIONS - 1)];
+
+	/* The response type is the command type plus one. */
+	if (!trans->in_use || trans->transaction_id != cmdh->transaction_id ||
+	    trans->if_id != cmdh->if_id ||
+	    trans->cmd + 1 != cmdh->command_type)
+		return false;
+
+	trans->in_use = false;
+
+	if (trans->done)
+		trans->done(ipc_mux, trans->if_id, &cmdh->param);
+
+	return true;
+}
+
 /* Prepare mux Command */
 static struct mux_lite_cmdh *mux_lite_add_cmd(struct iosm_mux *ipc_mux, u32 cmd,
 					      struct mux_acb *acb, void *param,
@@ -101,12 +184,27 @@ static int mux_acb_alloc(struct iosm_mux *ipc_mux)
 
 int mux_dl_acb_send_cmds(struct iosm_mux *ipc_mux, u32 cmd_type, u8 if_id,
 			 u32 transaction_id, union mux_cmd_param *param,
-			 size_t res_size, bool blocking, bool respond)
+			 size_t res_size, bool respond,
+			 mux_transaction_done_t done)
 {
 	struct mux_acb *acb = &ipc_mux->acb;
+	struct mux_transaction *trans = NULL;
 	struct mux_lite_cmdh *ack_lite;
 	int ret = 0;
 
+	/* A command waits for its response in the slot of the transaction id
+	 * it gets. The slot is busy if CP still owes an older response.
+	 */
+	if (!respond) {
+		trans = &ipc_mux->trans[ipc_mux->tx_transaction_id &
+					(IPC_MUX_MAX_TRANSACTIONS - 1)];
+		if (trans->in_use) {
+			dev_err(ipc_mux->dev, "if_id %u: cmd %u no transaction",
+				if_id, cmd_type);
+			return -EBUSY;
+		}
+	}
+
 	acb->if_id = if_id;
 	ret = mux_acb_alloc(ipc_mux);
 	if (ret)
@@ -116,9 +214,24 @@ int mux_dl_acb_send_cmds(struct iosm_mux *ipc_mux, u32 cmd_type, u8 if_id,
 	if (respond)
 		ack_lite->transaction_id = (u32)transaction_id;
 
-	ret = mux_acb_send(ipc_mux, blocking);
+	ret = mux_acb_send(ipc_mux);
+	if (ret || !trans)
+		return ret;
 
-	return ret;
+	trans->done = done;
+	trans->expires = jiffies +
+			 msecs_to_jiffies(IPC_MUX_CMD_RUN_DEFAULT_TIMEOUT);
+	trans->transaction_id = ack_lite->transaction_id;
+	trans->cmd = cmd_type;
+	trans->if_id = if_id;
+	trans->in_use = true;
+
+	if (!hrtimer_active(&ipc_mux->trans_timer))
+		hrtimer_start(&ipc_mux->trans_timer,
+			      ms_to_ktime(IPC_MUX_CMD_RUN_DEFAULT_TIMEOUT),
+			      HRTIMER_MODE_REL);
+
+	return 0;
 }
 
 void mux_netif_tx_flowctrl(struct mux_session *session, int idx, bool on)
@@ -131,13 +244,15 @@ void mux_netif_tx_flowctrl(struct mux_session *session, int idx, bool on)
 static int mux_dl_cmdresps_decode_process(struct iosm_mux *ipc_mux,
 					  struct mux_lite_cmdh *cmdh)
 {
-	struct mux_acb *acb = &ipc_mux->acb;
-
 	switch (cmdh->command_type) {
 	case MUX_CMD_OPEN_SESSION_RESP:
 	case MUX_CMD_CLOSE_SESSION_RESP:
-		/* Resume the control application. */
-		acb->got_param = cmdh->param;
+		/* A late or cancelled response is dropped. */
+		if (!mux_transaction_complete(ipc_mux, cmdh))
+			dev_dbg(ipc_mux->dev,
+				"if_id %u: unexpected resp %u transaction %u",
+				cmdh->if_id, cmdh->command_type,
+				cmdh->transaction_id);
 		break;
 
 	case MUX_LITE_CMD_FLOW_CTL_ACK:
@@ -155,15 +270,11 @@ static int mux_dl_cmdresps_decode_process(struct iosm_mux *ipc_mux,
 		return -EINVAL;
 	}
 
-	acb->wanted_response = MUX_CMD_INVALID;
-	acb->got_response = cmdh->command_type;
-	complete(&ipc_mux->channel->ul_sem);
-
 	return 0;
 }
 
 static int mux_dl_dlcmds_decode_process(struct iosm_mux *ipc_mux,
-					struct mux_lite_cmdh *cmdh)
+					struct mux_lite_cmdh *cmdh, u32 size)
 {
 	union mux_cmd_param *param = &cmdh->param;
 	struct mux_session *session;
@@ -175,14 +286,13 @@ static int mux_dl_dlcmds_decode_process(struct iosm_mux *ipc_mux,
 	switch (cmdh->command_type) {
 	case MUX_LITE_CMD_FLOW_CTL:
 
-		if (cmdh->if_id >= ipc_mux->nr_sessions) {
+		session = ipc_mux_session_get(ipc_mux, cmdh->if_id);
+		if (!session) {
 			dev_err(ipc_mux->dev, "if_id [%d] not valid",
 				cmdh->if_id);
 			return -EINVAL; /* No session interface id. */
 		}
 
-		session = &ipc_mux->session[cmdh->if_id];
-
 		new_size = offsetof(struct mux_lite_cmdh, param) +
 			   sizeof(param->flow_ctl);
 		if (param->flow_ctl.mask == 0xFFFFFFFF) {
@@ -220,6 +330,27 @@ static int mux_dl_dlcmds_decode_process(struct iosm_mux *ipc_mux,
 		break;
 
 	case MUX_LITE_CMD_LINK_STATUS_REPORT:
+		session = ipc_mux_session_get(ipc_mux, cmdh->if_id);
+		if (!session)
+			break;
+
+		/* The report is kept as sent by CP, bounded by the command
+		 * and the received block.
+		 */
+		new_size = (int)min_t(u32, cmdh->cmd_len, size) -
+			   (int)offsetof(struct mux_lite_cmdh, param);
+		new_size = clamp_t(int, new_size, 0, IPC_MUX_LINK_STATUS_MAX);
+
+		spin_lock_bh(&ipc_mux->session_lock);
+		memcpy(session->link_status, &param->link_status.payload,
+		       new_size);
+		session->link_status_len = new_size;
+		session->link_status_cnt++;
+		session->link_status_time = jiffies;
+		spin_unlock_bh(&ipc_mux->session_lock);
+
+		dev_dbg(ipc_mux->dev, "if[%u] LINK STATUS %*ph", cmdh->if_id,
+			new_size, session->link_status);
 		break;
 
 	default:
@@ -237,7 +368,7 @@ static void mux_dl_cmd_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 		/* Unable to decode command response indicates the cmd_type
 		 * may be a command instead of response. So try to decoding it.
 		 */
-		if (!mux_dl_dlcmds_decode_process(ipc_mux, cmdh)) {
+		if (!mux_dl_dlcmds_decode_process(ipc_mux, cmdh, skb->len)) {
 			/* Decoded command may need a response. Give the
 			 * response according to the command type.
 			 */
@@ -261,7 +392,7 @@ static void mux_dl_cmd_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 
 			if (mux_dl_acb_send_cmds(ipc_mux, cmd, cmdh->if_id,
 						 cmdh->transaction_id, mux_cmd,
-						 size, false, true))
+						 size, true, NULL))
 				dev_err(ipc_mux->dev,
 					"if_id %d: cmd send failed",
 					cmdh->if_id);
@@ -272,7 +403,7 @@ static void mux_dl_cmd_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 /* Pass the DL packet to the netif layer. */
 static int mux_net_receive(struct iosm_mux *ipc_mux, int if_id,
 			   struct iosm_wwan *wwan, u32 offset, u8 service_class,
-			   struct sk_buff *skb)
+			   __be16 proto, struct sk_buff *skb)
 {
 	/* for "zero copy" use clone */
 	struct sk_buff *dest_skb = skb_clone(skb, GFP_ATOMIC);
@@ -293,14 +424,14 @@ static int mux_net_receive(struct iosm_mux *ipc_mux, int if_id,
 	/* Pass the packet to the netif layer. */
 	dest_skb->priority = service_class;
 
-	return ipc_wwan_receive(wwan, dest_skb, false);
+	return ipc_wwan_receive(wwan, dest_skb, proto);
 }
 
 /* Decode Flow Credit Table in the block */
 static void mux_dl_fcth_decode(struct iosm_mux *ipc_mux, void *block)
 {
 	struct ipc_mem_lite_gen_tbl *fct = (struct ipc_mem_lite_gen_tbl *)block;
-	struct iosm_wwan *wwan;
+	struct mux_session *session;
 	int ul_credits;
 	int if_id;
 
@@ -311,15 +442,14 @@ static void mux_dl_fcth_decode(struct iosm_mux *ipc_mux, void *block)
 	}
 
 	if_id = fct->if_id;
-	if (if_id >= ipc_mux->nr_sessions) {
+	session = ipc_mux_session_get(ipc_mux, if_id);
+	if (!session) {
 		dev_err(ipc_mux->dev, "not supported if_id: %d", if_id);
 		return;
 	}
 
 	/* Is the session active ? */
-	if_id = array_index_nospec(if_id, ipc_mux->nr_sessions);
-	wwan = ipc_mux->session[if_id].wwan;
-	if (!wwan) {
+	if (!session->wwan) {
 		dev_err(ipc_mux->dev, "session Net ID is NULL");
 		return;
 	}
@@ -327,16 +457,15 @@ static void mux_dl_fcth_decode(struct iosm_mux *ipc_mux, void *block)
 	ul_credits = fct->vfl.nr_of_bytes;
 
 	dev_dbg(ipc_mux->dev, "Flow_Credit:: if_id[%d] Old: %d Grants: %d",
-		if_id, ipc_mux->session[if_id].ul_flow_credits, ul_credits);
+		if_id, session->ul_flow_credits, ul_credits);
 
 	/* Update the Flow Credit information from ADB */
-	ipc_mux->session[if_id].ul_flow_credits += ul_credits;
+	session->ul_flow_credits += ul_credits;
 
 	/* Check whether the TX can be started */
-	if (ipc_mux->session[if_id].ul_flow_credits > 0) {
-		ipc_mux->session[if_id].net_tx_stop = false;
-		mux_netif_tx_flowctrl(&ipc_mux->session[if_id],
-				      ipc_mux->session[if_id].if_id, false);
+	if (session->ul_flow_credits > 0) {
+		session->net_tx_stop = false;
+		mux_netif_tx_flowctrl(session, session->if_id, false);
 	}
 }
 
@@ -344,9 +473,11 @@ static void mux_dl_fcth_decode(struct iosm_mux *ipc_mux, void *block)
 static void mux_dl_adgh_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 {
 	u32 pad_len, packet_offset;
+	struct mux_session *session;
 	struct iosm_wwan *wwan;
 	struct mux_adgh *adgh;
 	u8 *block = skb->data;
+	__be16 proto;
 	int rc = 0;
 	u8 if_id;
 
@@ -358,14 +489,14 @@ static void mux_dl_adgh_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 	}
 
 	if_id = adgh->if_id;
-	if (if_id >= ipc_mux->nr_sessions) {
+	session = ipc_mux_session_get(ipc_mux, if_id);
+	if (!session) {
 		dev_err(ipc_mux->dev, "invalid if_id while decoding %d", if_id);
 		return;
 	}
 
 	/* Is the session active ? */
-	if_id = array_index_nospec(if_id, ipc_mux->nr_sessions);
-	wwan = ipc_mux->session[if_id].wwan;
+	wwan = session->wwan;
 	if (!wwan) {
 		dev_err(ipc_mux->dev, "session Net ID is NULL");
 		return;
@@ -379,20 +510,31 @@ static void mux_dl_adgh_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 	 * omitted if HEAD_PAD_LEN = 20, then this field will have 4 bytes
 	 * set to zero
 	 */
-	pad_len =
-		ipc_mux->session[if_id].dl_head_pad_len - IPC_MEM_DL_ETH_OFFSET;
+	pad_len = session->dl_head_pad_len - IPC_MEM_DL_ETH_OFFSET;
 	packet_offset = sizeof(*adgh) + pad_len;
 
+	/* Take the IP version from the ADGH if CP has agreed to set it,
+	 * otherwise from the IP header.
+	 */
+	if (session->ipv4v6_hints)
+		proto = adgh->opt_ipv4v6 ? htons(ETH_P_IPV6) : htons(ETH_P_IP);
+	else if ((block[packet_offset] & 0xF0) == 0x60)
+		proto = htons(ETH_P_IPV6);
+	else if ((block[packet_offset] & 0xF0) == 0x40)
+		proto = htons(ETH_P_IP);
+	else
+		proto = htons(ETH_P_802_3);
+
 	if_id += ipc_mux->wwan_q_offset;
 
 	/* Pass the packet to the netif layer */
 	rc = mux_net_receive(ipc_mux, if_id, wwan, packet_offset,
-			     adgh->service_class, skb);
+			     adgh->service_class, proto, skb);
 	if (rc) {
 		dev_err(ipc_mux->dev, "mux adgh decoding error");
 		return;
 	}
-	ipc_mux->session[if_id].flush = 1;
+	session->flush = 1;
 }
 
 void ipc_mux_dl_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
@@ -402,6 +544,8 @@ void ipc_mux_dl_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 	if (!skb->data)
 		return;
 
+	ipc_pcie_pm_activity(ipc_mux->pcie);
+
 	/* Decode the MUX header type. */
 	signature = le32_to_cpup((__le32 *)skb->data);
 
@@ -490,7 +634,7 @@ static void mux_ul_adgh_finish(struct iosm_mux *ipc_mux)
 	if (ipc_mux->ul_flow == MUX_UL_ON_CREDITS) {
 		struct mux_session *session;
 
-		session = &ipc_mux->session[ul_adb->adgh->if_id];
+		session = ipc_mux_session_get(ipc_mux, ul_adb->adgh->if_id);
 		str = "available_credits";
 		bytes = (long long)session->ul_flow_credits;
 
@@ -529,30 +673,24 @@ static bool mux_ul_adb_allocate(struct iosm_mux *ipc_mux, struct mux_adb *adb,
 }
 
 /* Informs the network stack to stop sending further packets for all opened
- * sessions
+ * sessions. Called by the UL encoder with the session_lock held.
  */
 static void mux_stop_tx_for_all_sessions(struct iosm_mux *ipc_mux)
 {
 	struct mux_session *session;
-	int idx;
-
-	for (idx = 0; idx < ipc_mux->nr_sessions; idx++) {
-		session = &ipc_mux->session[idx];
-
-		if (!session->wwan)
-			continue;
 
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node)
 		session->net_tx_stop = true;
-	}
 }
 
-/* Sends Queue Level Table of all opened sessions */
+/* Sends Queue Level Table of all opened sessions. Called by the UL encoder
+ * with the session_lock held.
+ */
 static bool mux_lite_send_qlt(struct iosm_mux *ipc_mux)
 {
 	struct ipc_mem_lite_gen_tbl *qlt;
 	struct mux_session *session;
 	bool qlt_updated = false;
-	int i;
 	int qlt_size;
 
 	if (!ipc_mux->initialized || ipc_mux->state != MUX_S_ACTIVE)
@@ -561,15 +699,14 @@ static bool mux_lite_send_qlt(struct iosm_mux *ipc_mux)
 	qlt_size = offsetof(struct ipc_mem_lite_gen_tbl, vfl) +
 		   MUX_QUEUE_LEVEL * sizeof(struct mux_lite_vfl);
 
-	for (i = 0; i < ipc_mux->nr_sessions; i++) {
-		session = &ipc_mux->session[i];
-
-		if (!session->wwan || session->flow_ctl_mask != 0)
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node) {
+		if (session->flow_ctl_mask != 0)
 			continue;
 
 		if (mux_ul_skb_alloc(ipc_mux, &ipc_mux->ul_adb, MUX_SIG_QLTH)) {
 			dev_err(ipc_mux->dev,
-				"no reserved mem to send QLT of if_id: %d", i);
+				"no reserved mem to send QLT of if_id: %d",
+				session->if_id);
 			break;
 		}
 
@@ -578,7 +715,7 @@ static bool mux_lite_send_qlt(struct iosm_mux *ipc_mux)
 			      ->data;
 		qlt->signature = MUX_SIG_QLTH;
 		qlt->length = qlt_size;
-		qlt->if_id = i;
+		qlt->if_id = session->if_id;
 		qlt->vfl_length = MUX_QUEUE_LEVEL * sizeof(struct mux_lite_vfl);
 		qlt->reserved[0] = 0;
 		qlt->reserved[1] = 0;
@@ -705,6 +842,19 @@ static int mux_ul_adgh_encode(struct iosm_mux *ipc_mux, int session_id,
 
 		ipc_mux->size_needed = sizeof(struct mux_adgh) + aligned_size;
 
+		/* A packet which does not fit into an empty ADGH would block
+		 * the session for good.
+		 */
+		if (ipc_mux->size_needed > IPC_MEM_MAX_DL_MUX_LITE_BUF_SIZE) {
+			dev_err_ratelimited(ipc_mux->dev,
+					    "if %d: UL packet too big (%u)",
+					    session_id, src_skb->len);
+			ipc_mux->size_needed = 0;
+			dev_kfree_skb(skb_dequeue(ul_list));
+			nr_of_pkts--;
+			continue;
+		}
+
 		if (ipc_mux->size_needed > adb->size) {
 			dev_dbg(ipc_mux->dev, "size needed %d, adgh size %d",
 				ipc_mux->size_needed, adb->size);
@@ -726,6 +876,9 @@ static int mux_ul_adgh_encode(struct iosm_mux *ipc_mux, int session_id,
 		adb->adgh->if_id = session_id;
 		adb->adgh->length =
 			sizeof(struct mux_adgh) + pad_len + src_skb->len;
+		/* The IP header was just copied, tell CP the IP version. */
+		adb->adgh->opt_ipv4v6 = session->ipv4v6_hints &&
+					(src_skb->data[0] & 0xF0) == 0x60;
 		adb->adgh->service_class = src_skb->priority;
 		adb->adgh->next_count = --nr_of_pkts;
 		adb->dg_cnt_total++;
@@ -768,9 +921,7 @@ bool ipc_mux_ul_data_encode(struct iosm_mux *ipc_mux)
 	struct sk_buff_head *ul_list;
 	struct mux_session *session;
 	int updated = 0;
-	int session_id;
 	int dg_n;
-	int i;
 
 	if (!ipc_mux || ipc_mux->state != MUX_S_ACTIVE ||
 	    ipc_mux->adb_prep_ongoing)
@@ -778,17 +929,11 @@ bool ipc_mux_ul_data_encode(struct iosm_mux *ipc_mux)
 
 	ipc_mux->adb_prep_ongoing = true;
 
-	for (i = 0; i < ipc_mux->nr_sessions; i++) {
-		session_id = ipc_mux->rr_next_session;
-		session = &ipc_mux->session[session_id];
-
-		/* Go to next handle rr_next_session overflow */
-		ipc_mux->rr_next_session++;
-		if (ipc_mux->rr_next_session >= ipc_mux->nr_sessions)
-			ipc_mux->rr_next_session = 0;
+	spin_lock_bh(&ipc_mux->session_lock);
 
-		if (!session->wwan || session->flow_ctl_mask ||
-		    session->net_tx_stop)
+	/* Only the open sessions are visited. */
+	list_for_each_entry(session, &ipc_mux->active_sessions, active_node) {
+		if (session->flow_ctl_mask || session->net_tx_stop)
 			continue;
 
 		ul_list = &session->ul_list;
@@ -804,10 +949,16 @@ bool ipc_mux_ul_data_encode(struct iosm_mux *ipc_mux)
 			 */
 			continue;
 
-		updated = mux_ul_adgh_encode(ipc_mux, session_id, session,
+		updated = mux_ul_adgh_encode(ipc_mux, session->if_id, session,
 					     ul_list, &ipc_mux->ul_adb, dg_n);
 	}
 
+	/* Round robin: the next encode starts with the following session. */
+	if (!list_empty(&ipc_mux->active_sessions))
+		list_rotate_left(&ipc_mux->active_sessions);
+
+	spin_unlock_bh(&ipc_mux->session_lock);
+
 	ipc_mux->adb_prep_ongoing = false;
 	return updated == 1;
 }
@@ -833,9 +984,8 @@ void ipc_mux_ul_encoded_process(struct iosm_mux *ipc_mux, struct sk_buff *skb)
 	skb_queue_tail((&ipc_mux->ul_adb.free_list), skb);
 }
 
-/* Start the NETIF uplink send transfer in MUX mode. */
-static int mux_tq_ul_trigger_encode(struct iosm_imem *ipc_imem, int arg,
-				    void *msg, size_t size)
+int mux_tq_ul_trigger_encode(struct iosm_imem *ipc_imem, int arg, void *msg,
+			     size_t size)
 {
 	struct iosm_mux *ipc_mux = ipc_imem->mux;
 	bool ul_data_pend = false;
@@ -846,16 +996,13 @@ static int mux_tq_ul_trigger_encode(struct iosm_imem *ipc_imem, int arg,
 		/* Delay the doorbell irq */
 		imem_td_update_timer_start(ipc_mux->imem);
 
-	/* reset the debounce flag */
-	ipc_mux->ev_mux_net_transmit_pending = false;
-
 	return 0;
 }
 
 int ipc_mux_ul_trigger_encode(struct iosm_mux *ipc_mux, int if_id,
 			      struct sk_buff *skb)
 {
-	struct mux_session *session = &ipc_mux->session[if_id];
+	struct mux_session *session = ipc_mux_session_get(ipc_mux, if_id);
 
 	if (ipc_mux->channel &&
 	    ipc_mux->channel->state != IMEM_CHANNEL_ACTIVE) {
@@ -864,7 +1011,7 @@ int ipc_mux_ul_trigger_encode(struct iosm_mux *ipc_mux, int if_id,
 		return -1;
 	}
 
-	if (!session->wwan) {
+	if (!session || !session->wwan) {
 		dev_err(ipc_mux->dev, "session net ID is NULL");
 		return -1;
 	}
@@ -885,14 +1032,11 @@ int ipc_mux_ul_trigger_encode(struct iosm_mux *ipc_mux, int if_id,
 	/* Add skb to the uplink skb accumulator. */
 	skb_queue_tail(&session->ul_list, skb);
 
-	/* Inform the IPC kthread to pass uplink IP packets to CP. */
-	if (!ipc_mux->ev_mux_net_transmit_pending) {
-		ipc_mux->ev_mux_net_transmit_pending = true;
-		if (ipc_task_queue_send_task(ipc_mux->imem,
-					     mux_tq_ul_trigger_encode, 0, NULL,
-					     0, false))
-			return -EAGAIN;
-	}
+	/* UL data restarts the autosuspend delay or wakes the modem. */
+	ipc_pcie_pm_activity(ipc_mux->pcie);
+
+	/* Inform the IPC tasklet to pass uplink IP packets to CP. */
+	ipc_task_queue_send_event(ipc_mux->imem, IPC_TASK_EV_MUX_UL_ENCODE);
 	dev_dbg(ipc_mux->dev, "mux ul if[%d] qlen=%d/%u, len=%d/%d, prio=%d",
 		if_id, skb_queue_len(&session->ul_list), session->ul_list.qlen,
 		skb->len, skb->truesize, skb->priority);
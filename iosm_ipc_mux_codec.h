@@ -145,14 +145,34 @@ void ipc_mux_dl_decode(struct iosm_mux *ipc_mux, struct sk_buff *skb);
  * @transaction_id:	Command transaction id.
  * @param:		Pointer to command params.
  * @res_size:		Response size
- * @blocking:		True for blocking send
  * @respond:		If true return transaction ID
+ * @done:		Response handler of a command, may be NULL. Only used
+ *			if respond is false.
  *
- * Returns: 0 in success and -ve for failure
+ * A command, other than a response, occupies a transaction slot until CP
+ * responds or IPC_MUX_CMD_RUN_DEFAULT_TIMEOUT expires.
+ *
+ * Returns: 0 in success, -EBUSY if the transaction slot is busy and
+ *	    -ve for other failures
  */
 int mux_dl_acb_send_cmds(struct iosm_mux *ipc_mux, u32 cmd_type, u8 if_id,
 			 u32 transaction_id, union mux_cmd_param *param,
-			 size_t res_size, bool blocking, bool respond);
+			 size_t res_size, bool respond,
+			 mux_transaction_done_t done);
+
+/**
+ * mux_transactions_init - Initialize the MUX command transaction table.
+ * @ipc_mux:	Pointer to MUX data-struct
+ */
+void mux_transactions_init(struct iosm_mux *ipc_mux);
+
+/**
+ * mux_transactions_cancel - Drop the commands waiting for a response
+ *			     without calling their handler.
+ * @ipc_mux:	Pointer to MUX data-struct
+ * @if_id:	Session interface id or -1 for all sessions
+ */
+void mux_transactions_cancel(struct iosm_mux *ipc_mux, int if_id);
 
 /**
  * mux_netif_tx_flowctrl - Enable/Disable TX flow control on MUX sessions.
@@ -162,6 +182,20 @@ int mux_dl_acb_send_cmds(struct iosm_mux *ipc_mux, u32 cmd_type, u8 if_id,
  */
 void mux_netif_tx_flowctrl(struct mux_session *session, int idx, bool on);
 
+/**
+ * mux_tq_ul_trigger_encode - Encode the UL data of the sessions and start
+ *			      the transfer. Handler of the
+ *			      IPC_TASK_EV_MUX_UL_ENCODE tasklet event.
+ * @ipc_imem:	Pointer to iosm_imem struct
+ * @arg:	Unused
+ * @msg:	Unused
+ * @size:	Unused
+ *
+ * Returns: 0
+ */
+int mux_tq_ul_trigger_encode(struct iosm_imem *ipc_imem, int arg, void *msg,
+			     size_t size);
+
 /**
  * ipc_mux_ul_trigger_encode - Route the UL packet through the IP MUX layer
  *			       for encoding.
@@ -6,6 +6,7 @@
 #include <linux/acpi.h>
 #include <linux/bitfield.h>
 #include <linux/module.h>
+#include <linux/pm_runtime.h>
 
 #include "iosm_ipc_imem.h"
 #include "iosm_ipc_pcie.h"
@@ -17,6 +18,14 @@ MODULE_AUTHOR(DRV_AUTHOR);
 MODULE_DESCRIPTION("IOSM Driver");
 MODULE_LICENSE("GPL v2");
 
+/* Idle time before runtime PM puts the modem to sleep. A negative value
+ * keeps runtime PM disabled, it may still be enabled through sysfs.
+ */
+static int autosuspend_delay_ms = 5000;
+module_param(autosuspend_delay_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_delay_ms,
+		 "Runtime PM autosuspend delay in ms (-1 = disabled)");
+
 /* WWAN GUID */
 static guid_t wwan_acpi_guid = GUID_INIT(0xbad01b75, 0x22a8, 0x4f48, 0x87, 0x92,
 				       0xbd, 0xde, 0x94, 0x67, 0x74, 0x7d);
@@ -56,10 +65,83 @@ static void ipc_pcie_deinit(struct iosm_pcie *ipc_pcie)
 	kfree(ipc_pcie);
 }
 
+/* Number of runtime resumes, wake latency of the last one, the largest
+ * and the average wake latency in usec. The latency is measured from the
+ * first wake request to the end of the resume.
+ */
+static ssize_t wake_latency_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+	u32 nr_wakes;
+
+	if (!ipc_pcie)
+		return -ENODEV;
+
+	nr_wakes = ipc_pcie->pm_nr_wakes;
+
+	return scnprintf(buf, PAGE_SIZE, "%u %u %u %llu\n", nr_wakes,
+			 ipc_pcie->pm_wake_last_us, ipc_pcie->pm_wake_max_us,
+			 nr_wakes ? div_u64(ipc_pcie->pm_wake_total_us,
+					    nr_wakes) : 0);
+}
+
+static DEVICE_ATTR_RO(wake_latency);
+
+static struct attribute *ipc_pcie_pm_attrs[] = {
+	&dev_attr_wake_latency.attr,
+	NULL,
+};
+
+static const struct attribute_group ipc_pcie_pm_attr_group = {
+	.name = "iosm_pm",
+	.attrs = ipc_pcie_pm_attrs,
+};
+
+/* Enable runtime PM with autosuspend for the bound device. */
+static void ipc_pcie_runtime_pm_init(struct iosm_pcie *ipc_pcie)
+{
+	struct device *dev = ipc_pcie->dev;
+
+	/* Export the wake latency of the runtime resumes. */
+	if (sysfs_create_group(&dev->kobj, &ipc_pcie_pm_attr_group))
+		dev_err(dev, "wake latency attributes failed");
+	else
+		ipc_pcie->pm_sysfs_registered = true;
+
+	pm_runtime_set_autosuspend_delay(dev, autosuspend_delay_ms);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_mark_last_busy(dev);
+
+	/* Drop the usage count the PCI core holds across probe. */
+	pm_runtime_put_noidle(dev);
+
+	/* The PCI core starts the device with runtime PM forbidden. */
+	if (autosuspend_delay_ms >= 0)
+		pm_runtime_allow(dev);
+}
+
+static void ipc_pcie_runtime_pm_deinit(struct iosm_pcie *ipc_pcie)
+{
+	struct device *dev = ipc_pcie->dev;
+
+	if (autosuspend_delay_ms >= 0)
+		pm_runtime_forbid(dev);
+
+	/* Take back the usage count dropped in probe. */
+	pm_runtime_get_noresume(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+
+	if (ipc_pcie->pm_sysfs_registered)
+		sysfs_remove_group(&dev->kobj, &ipc_pcie_pm_attr_group);
+}
+
 static void iosm_ipc_remove(struct pci_dev *pci)
 {
 	struct iosm_pcie *ipc_pcie = pci_get_drvdata(pci);
 
+	ipc_pcie_runtime_pm_deinit(ipc_pcie);
+
 	ipc_cleanup(ipc_pcie);
 
 	ipc_pcie_deinit(ipc_pcie);
@@ -255,7 +337,8 @@ default_ret:
 static int iosm_ipc_probe(struct pci_dev *pci,
 			  const struct pci_device_id *pci_id)
 {
-	struct iosm_pcie *ipc_pcie = kzalloc(sizeof(*ipc_pcie), GFP_KERNEL);
+	struct iosm_pcie *ipc_pcie = kzalloc_node(sizeof(*ipc_pcie), GFP_KERNEL,
+						  dev_to_node(&pci->dev));
 
 	pr_debug("Probing device 0x%X from the vendor 0x%X", pci_id->device,
 		 pci_id->vendor);
@@ -307,6 +390,8 @@ static int iosm_ipc_probe(struct pci_dev *pci,
 		goto imem_init_fail;
 	}
 
+	ipc_pcie_runtime_pm_init(ipc_pcie);
+
 	return 0;
 
 imem_init_fail:
@@ -432,6 +517,9 @@ static int __maybe_unused iosm_ipc_suspend_cb(struct device *dev)
 
 	ipc_pcie = pci_get_drvdata(pdev);
 
+	/* The system sleep flows start from an awake modem. */
+	pm_runtime_resume(dev);
+
 	switch (ipc_pcie->d3l2_support) {
 	case IPC_PCIE_D0L12:
 		iosm_ipc_suspend_s2idle(ipc_pcie);
@@ -465,7 +553,109 @@ static int __maybe_unused iosm_ipc_resume_cb(struct device *dev)
 	return 0;
 }
 
-static SIMPLE_DEV_PM_OPS(iosm_ipc_pm, iosm_ipc_suspend_cb, iosm_ipc_resume_cb);
+/* Account the wake latency of a runtime resume which started at start_ns. */
+static void ipc_pcie_pm_wake_done(struct iosm_pcie *ipc_pcie, u64 start_ns)
+{
+	u64 req_ns = atomic64_xchg(&ipc_pcie->pm_wake_req_ns, 0);
+	u32 latency_us;
+
+	if (req_ns && req_ns < start_ns)
+		start_ns = req_ns;
+
+	latency_us = div_u64(ktime_get_ns() - start_ns, NSEC_PER_USEC);
+
+	ipc_pcie->pm_wake_last_us = latency_us;
+	if (latency_us > ipc_pcie->pm_wake_max_us)
+		ipc_pcie->pm_wake_max_us = latency_us;
+	ipc_pcie->pm_wake_total_us += latency_us;
+	ipc_pcie->pm_nr_wakes++;
+
+	dev_dbg(ipc_pcie->dev, "runtime resume after %u us", latency_us);
+}
+
+/* Put an idle modem to sleep through the host sleep protocol. In D3L2 the
+ * PCI core moves the device to D3 afterwards, in D0L12 it stays in D0 and
+ * ASPM takes the link to L1.2.
+ */
+static int __maybe_unused iosm_ipc_runtime_suspend(struct device *dev)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+
+	/* Only a modem in the runtime phase knows the host sleep. */
+	if (ipc_pcie->imem->phase != IPC_P_RUN)
+		goto busy;
+
+	atomic64_set(&ipc_pcie->pm_wake_req_ns, 0);
+
+	if (ipc_imem_pm_suspend(ipc_pcie->imem))
+		goto busy;
+
+	/* Activity during the sleep handshake cancels the suspend. */
+	if (pm_runtime_autosuspend_expiration(dev)) {
+		ipc_imem_pm_resume(ipc_pcie->imem);
+		goto busy;
+	}
+
+	/* A saved state keeps the PCI core from changing the power state. */
+	if (ipc_pcie->d3l2_support == IPC_PCIE_D0L12)
+		pci_save_state(ipc_pcie->pci);
+
+	dev_dbg(ipc_pcie->dev, "runtime suspend done");
+	return 0;
+
+busy:
+	/* Retry after the next autosuspend delay. */
+	pm_runtime_mark_last_busy(dev);
+	return -EBUSY;
+}
+
+static int __maybe_unused iosm_ipc_runtime_resume(struct device *dev)
+{
+	struct iosm_pcie *ipc_pcie = dev_get_drvdata(dev);
+	u64 start_ns = ktime_get_ns();
+
+	ipc_imem_pm_resume(ipc_pcie->imem);
+
+	ipc_pcie_pm_wake_done(ipc_pcie, start_ns);
+	pm_runtime_mark_last_busy(dev);
+
+	return 0;
+}
+
+void ipc_pcie_pm_activity(struct iosm_pcie *ipc_pcie)
+{
+	struct device *dev = ipc_pcie->dev;
+
+	pm_runtime_mark_last_busy(dev);
+
+	if (pm_runtime_active(dev))
+		return;
+
+	if (pm_runtime_suspended(dev))
+		atomic64_cmpxchg(&ipc_pcie->pm_wake_req_ns, 0, ktime_get_ns());
+
+	pm_request_resume(dev);
+}
+
+void ipc_pcie_pm_wake(struct iosm_pcie *ipc_pcie)
+{
+	struct device *dev = ipc_pcie->dev;
+
+	if (pm_runtime_suspended(dev))
+		atomic64_cmpxchg(&ipc_pcie->pm_wake_req_ns, 0, ktime_get_ns());
+
+	if (pm_runtime_get_sync(dev) < 0)
+		dev_err(dev, "runtime resume failed");
+
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+static const struct dev_pm_ops iosm_ipc_pm = {
+	SET_SYSTEM_SLEEP_PM_OPS(iosm_ipc_suspend_cb, iosm_ipc_resume_cb)
+	SET_RUNTIME_PM_OPS(iosm_ipc_runtime_suspend, iosm_ipc_runtime_resume,
+			   NULL)
+};
 
 static struct pci_driver iosm_ipc_driver = {
 	.name = KBUILD_MODNAME,
@@ -506,13 +696,27 @@ struct sk_buff *ipc_pcie_alloc_local_skb(struct iosm_pcie *ipc_pcie,
 					 gfp_t flags, size_t size)
 {
 	struct sk_buff *skb;
+	int node;
 
 	if (!ipc_pcie || !size) {
 		pr_err("invalid pcie object or size");
 		return NULL;
 	}
 
-	skb = __netdev_alloc_skb(NULL, size, flags);
+	node = dev_to_node(ipc_pcie->dev);
+
+	/* On a multi node system keep the buffer on the memory node of the
+	 * device, the page fragment cache of __netdev_alloc_skb() is filled
+	 * from the node of the current CPU.
+	 */
+	if (node == NUMA_NO_NODE || nr_online_nodes == 1) {
+		skb = __netdev_alloc_skb(NULL, size, flags);
+	} else {
+		skb = __alloc_skb(size + NET_SKB_PAD, flags, 0, node);
+		if (skb)
+			skb_reserve(skb, NET_SKB_PAD);
+	}
+
 	if (!skb)
 		return NULL;
 
@@ -59,6 +59,13 @@ enum ipc_pcie_sleep_state {
  * @doorbell_capture:		doorbell capture resgister
  * @suspend:			S2IDLE sleep/active
  * @d3l2_support:		Read WWAN RTD3 BIOS setting for D3L2 support
+ * @pm_wake_req_ns:		Time of the first wake request while runtime
+ *				suspended, 0 if none is pending
+ * @pm_nr_wakes:		Number of runtime resumes
+ * @pm_wake_last_us:		Wake latency of the last runtime resume
+ * @pm_wake_max_us:		Largest wake latency
+ * @pm_wake_total_us:		Sum of the wake latencies
+ * @pm_sysfs_registered:	The wake latency attributes are registered
  */
 struct iosm_pcie {
 	struct pci_dev *pci;
@@ -74,6 +81,12 @@ struct iosm_pcie {
 	u32 doorbell_capture;
 	unsigned long suspend;
 	enum ipc_pcie_sleep_state d3l2_support;
+	atomic64_t pm_wake_req_ns;
+	u32 pm_nr_wakes;
+	u32 pm_wake_last_us;
+	u32 pm_wake_max_us;
+	u64 pm_wake_total_us;
+	u8 pm_sysfs_registered : 1;
 };
 
 /**
@@ -192,6 +205,21 @@ int iosm_ipc_suspend(struct iosm_pcie *ipc_pcie);
  */
 int iosm_ipc_resume(struct iosm_pcie *ipc_pcie);
 
+/**
+ * ipc_pcie_pm_activity - Mark the device busy for runtime PM and request an
+ *			  asynchronous resume if it sleeps. May be called in
+ *			  any context.
+ * @ipc_pcie:	Pointer to struct iosm_pcie
+ */
+void ipc_pcie_pm_activity(struct iosm_pcie *ipc_pcie);
+
+/**
+ * ipc_pcie_pm_wake - Resume the device if it is runtime suspended and mark
+ *		      it busy. Sleeps until the resume is done.
+ * @ipc_pcie:	Pointer to struct iosm_pcie
+ */
+void ipc_pcie_pm_wake(struct iosm_pcie *ipc_pcie);
+
 /**
  * ipc_pcie_check_aspm_enabled - Check if ASPM L1 is already enabled
  * @ipc_pcie:			 Pointer to struct iosm_pcie
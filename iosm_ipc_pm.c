@@ -288,9 +288,25 @@ bool ipc_pm_dev_slp_notification(struct iosm_pm *ipc_pm, u32 cp_pm_req)
 	return false;
 }
 
+void ipc_pm_reset(struct iosm_pm *ipc_pm)
+{
+	/* A restarted CP starts with an active link and no pending
+	 * sleep negotiation.
+	 */
+	ipc_pm->pm_cond.irq = IPC_PM_SLEEP;
+	ipc_pm->pm_cond.hs = IPC_PM_SLEEP;
+	ipc_pm->pm_cond.link = IPC_PM_ACTIVE;
+
+	ipc_pm->cp_state = IPC_MEM_DEV_PM_ACTIVE;
+	ipc_pm->ap_state = IPC_MEM_DEV_PM_ACTIVE;
+	ipc_pm->device_sleep_notification = 0;
+	ipc_pm->pending_hpda_update = false;
+}
+
 struct iosm_pm *ipc_pm_init(struct iosm_imem *ipc_imem)
 {
-	struct iosm_pm *ipc_pm = kzalloc(sizeof(*ipc_pm), GFP_KERNEL);
+	struct iosm_pm *ipc_pm = kzalloc_node(sizeof(*ipc_pm), GFP_KERNEL,
+					      dev_to_node(ipc_imem->dev));
 
 	if (!ipc_pm)
 		return NULL;
@@ -141,6 +141,12 @@ struct iosm_pm *ipc_pm_init(struct iosm_imem *ipc_imem);
  */
 void ipc_pm_deinit(struct iosm_pm *ipc_pm);
 
+/**
+ * ipc_pm_reset - Reset the device sleep state machine after a modem restart
+ * @ipc_pm:	Pointer to power management component
+ */
+void ipc_pm_reset(struct iosm_pm *ipc_pm);
+
 /**
  * ipc_pm_dev_slp_notification - Handle a sleep notification message from the
  *				 device. This can be called from interrupt state
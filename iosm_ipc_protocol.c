@@ -25,38 +25,175 @@ int ipc_protocol_tq_msg_send(struct iosm_protocol *ipc_protocol,
 	return index;
 }
 
-/* Callback for message send */
+/* Callback for message send. A message which could not be queued is
+ * completed with an error status.
+ */
 static int ipc_protocol_tq_msg_send_cb(struct iosm_imem *ipc_imem, int arg,
 				       void *msg, size_t size)
 {
 	struct ipc_call_msg_send_args *send_args = msg;
 	struct iosm_protocol *ipc_protocol = ipc_imem->ipc_protocol;
+	int index;
+
+	index = ipc_protocol_tq_msg_send(ipc_protocol, send_args->msg_type,
+					 &send_args->prep_args,
+					 send_args->response);
+	if (index < 0 || index >= IPC_MEM_MSG_ENTRIES)
+		ipc_protocol_rsp_complete(send_args->response,
+					  IPC_MEM_MSG_CS_ERROR);
 
-	return ipc_protocol_tq_msg_send(ipc_protocol, send_args->msg_type,
-					send_args->prep_args,
-					send_args->response);
+	return 0;
 }
 
-/* Remove reference to a response. This is typically used when a requestor timed
- * out and is no longer interested in the response.
+/* Complete the response of a message whose task was dropped with the
+ * task queue.
  */
-static int ipc_protocol_tq_msg_remove(struct iosm_imem *ipc_imem, int arg,
-				      void *msg, size_t size)
+static void ipc_protocol_msg_send_done(struct iosm_imem *ipc_imem, int arg,
+				       int response, void *ctx)
+{
+	if (response < 0)
+		ipc_protocol_rsp_complete(ctx, IPC_MEM_MSG_CS_ERROR);
+}
+
+int ipc_protocol_msg_send_async(struct iosm_protocol *ipc_protocol,
+				enum ipc_msg_prep_type prep,
+				union ipc_msg_prep_args *prep_args,
+				struct ipc_rsp *response)
+{
+	struct ipc_call_msg_send_args send_args;
+
+	response->status = IPC_MEM_MSG_CS_INVALID;
+
+	send_args.msg_type = prep;
+	send_args.prep_args = *prep_args;
+	send_args.response = response;
+
+	/* The arguments are copied into the task queue, the caller may
+	 * release prep_args on return.
+	 */
+	if (ipc_task_queue_send_async(ipc_protocol->imem, IPC_TASK_LANE_CTRL,
+				      ipc_protocol_tq_msg_send_cb, 0,
+				      &send_args, sizeof(send_args),
+				      ipc_protocol_msg_send_done, response)) {
+		dev_err(ipc_protocol->dev, "msg %d failed", prep);
+		return -1;
+	}
+
+	return 0;
+}
+
+int ipc_protocol_tq_msg_send_batch(struct iosm_protocol *ipc_protocol,
+				   struct ipc_msg_batch_entry *entries, int nr,
+				   bool track)
+{
+	struct iosm_imem *ipc_imem = ipc_protocol->imem;
+	int index;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		index = ipc_protocol_msg_prep(ipc_imem, entries[i].msg_type,
+					      &entries[i].prep_args);
+		if (index < 0 || index >= IPC_MEM_MSG_ENTRIES)
+			break;
+
+		entries[i].index = index;
+		ipc_protocol->rsp_ring[index] = track ? &entries[i].response :
+							NULL;
+		ipc_protocol_msg_hp_advance(ipc_imem);
+	}
+
+	if (i > 0)
+		ipc_pm_signal_hpda_doorbell(ipc_protocol->pm, IPC_HP_MR, false);
+
+	return i;
+}
+
+/* Callback for batched message send. The messages which did not fit into the
+ * message ring are completed with an error status.
+ */
+static int ipc_protocol_tq_msg_send_batch_cb(struct iosm_imem *ipc_imem,
+					     int arg, void *msg, size_t size)
+{
+	struct ipc_msg_batch_entry *entries = msg;
+	int i;
+
+	i = ipc_protocol_tq_msg_send_batch(ipc_imem->ipc_protocol, entries,
+					   arg, true);
+
+	for (; i < arg; i++)
+		ipc_protocol_rsp_complete(&entries[i].response,
+					  IPC_MEM_MSG_CS_ERROR);
+
+	return 0;
+}
+
+/* Complete the responses of a batch whose task was dropped with the task
+ * queue.
+ */
+static void ipc_protocol_msg_batch_done(struct iosm_imem *ipc_imem, int arg,
+					int response, void *ctx)
+{
+	struct ipc_msg_batch_entry *entries = ctx;
+	int i;
+
+	if (response >= 0)
+		return;
+
+	for (i = 0; i < arg; i++)
+		ipc_protocol_rsp_complete(&entries[i].response,
+					  IPC_MEM_MSG_CS_ERROR);
+}
+
+/* Remove the references to the responses of a batch which timed out. */
+static int ipc_protocol_tq_msg_remove_batch(struct iosm_imem *ipc_imem,
+					    int arg, void *msg, size_t size)
 {
 	struct iosm_protocol *ipc_protocol = ipc_imem->ipc_protocol;
+	struct ipc_msg_batch_entry *entries = msg;
+	int i;
+
+	for (i = 0; i < arg; i++) {
+		if (entries[i].index >= 0 &&
+		    ipc_protocol->rsp_ring[entries[i].index] ==
+			    &entries[i].response)
+			ipc_protocol->rsp_ring[entries[i].index] = NULL;
+	}
 
-	ipc_protocol->rsp_ring[arg] = NULL;
 	return 0;
 }
 
-int ipc_protocol_msg_send(struct iosm_protocol *ipc_protocol,
-			  enum ipc_msg_prep_type prep,
-			  union ipc_msg_prep_args *prep_args)
+int ipc_protocol_msg_send_batch_async(struct iosm_protocol *ipc_protocol,
+				      struct ipc_msg_batch_entry *entries,
+				      int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		entries[i].index = -1;
+		entries[i].response.status = IPC_MEM_MSG_CS_INVALID;
+	}
+
+	/* The entries hold the response objects, they are not copied. */
+	if (ipc_task_queue_send_async(ipc_protocol->imem, IPC_TASK_LANE_CTRL,
+				      ipc_protocol_tq_msg_send_batch_cb, nr,
+				      entries, 0, ipc_protocol_msg_batch_done,
+				      entries)) {
+		dev_err(ipc_protocol->dev, "msg batch of %d failed", nr);
+		return -1;
+	}
+
+	return 0;
+}
+
+int ipc_protocol_msg_send_batch(struct iosm_protocol *ipc_protocol,
+				struct ipc_msg_batch_entry *entries, int nr)
 {
-	struct ipc_call_msg_send_args send_args;
 	unsigned int exec_timeout;
-	struct ipc_rsp response;
-	int index;
+	bool timed_out = false;
+	unsigned long deadline;
+	long remaining;
+	int result = 0;
+	int i;
 
 	exec_timeout = (ipc_protocol_get_ap_exec_stage(ipc_protocol) ==
 					IPC_MEM_EXEC_STAGE_RUN ?
@@ -66,51 +203,63 @@ int ipc_protocol_msg_send(struct iosm_protocol *ipc_protocol,
 	/* Trap if called from non-preemptible context */
 	might_sleep();
 
-	response.status = IPC_MEM_MSG_CS_INVALID;
-	init_completion(&response.completion);
+	for (i = 0; i < nr; i++) {
+		entries[i].response.done = NULL;
+		init_completion(&entries[i].response.completion);
+	}
 
-	send_args.msg_type = prep;
-	send_args.prep_args = prep_args;
-	send_args.response = &response;
+	if (ipc_protocol_msg_send_batch_async(ipc_protocol, entries, nr))
+		return -1;
 
-	/* Allocate and prepare message to be sent in tasklet context.
-	 * A positive index returned form tasklet_call references the message
-	 * in case it needs to be cancelled when there is a timeout.
+	/* CP consumes the message ring in one go, so the whole batch shares
+	 * one timeout. A message which was not queued is already completed.
 	 */
-	index = ipc_task_queue_send_task(ipc_protocol->imem,
-					 ipc_protocol_tq_msg_send_cb, 0,
-					 &send_args, 0, true);
+	deadline = jiffies + msecs_to_jiffies(exec_timeout);
+
+	for (i = 0; i < nr; i++) {
+		remaining = (long)(deadline - jiffies);
+		if (remaining < 0)
+			remaining = 0;
+
+		if (!wait_for_completion_timeout(&entries[i].response.completion,
+						 remaining)) {
+			timed_out = true;
+			result = -1;
+			continue;
+		}
 
-	if (index < 0) {
-		dev_err(ipc_protocol->dev, "msg %d failed", prep);
-		return index;
+		if (entries[i].response.status != IPC_MEM_MSG_CS_SUCCESS) {
+			dev_err(ipc_protocol->dev,
+				"msg completion status error %d",
+				entries[i].response.status);
+			result = -1;
+		}
 	}
 
-	/* Wait for the device to respond to the message */
-	switch (wait_for_completion_timeout(&response.completion,
-					    msecs_to_jiffies(exec_timeout))) {
-	case 0:
-		/* Timeout, there was no response from the device.
-		 * Remove the reference to the local response completion
-		 * object as we are no longer interested in the response.
+	if (timed_out) {
+		/* Drop the references to the local response objects which
+		 * are still pending in the response ring.
 		 */
 		ipc_task_queue_send_task(ipc_protocol->imem,
-					 ipc_protocol_tq_msg_remove, index,
-					 NULL, 0, true);
-		dev_err(ipc_protocol->dev, "msg timeout");
+					 ipc_protocol_tq_msg_remove_batch, nr,
+					 entries, 0, true);
+		dev_err(ipc_protocol->dev, "msg batch timeout");
 		ipc_uevent_send(ipc_protocol->pcie->dev, UEVENT_MDM_TIMEOUT);
-		break;
-	default:
-		/* We got a response in time; check completion status: */
-		if (response.status != IPC_MEM_MSG_CS_SUCCESS) {
-			dev_err(ipc_protocol->dev,
-				"msg completion status error %d",
-				response.status);
-			return -1;
-		}
 	}
 
-	return 0;
+	return result;
+}
+
+int ipc_protocol_msg_send(struct iosm_protocol *ipc_protocol,
+			  enum ipc_msg_prep_type prep,
+			  union ipc_msg_prep_args *prep_args)
+{
+	struct ipc_msg_batch_entry entry = {
+		.msg_type = prep,
+		.prep_args = *prep_args,
+	};
+
+	return ipc_protocol_msg_send_batch(ipc_protocol, &entry, 1);
 }
 
 static int ipc_protocol_msg_send_host_sleep(struct iosm_protocol *ipc_protocol,
@@ -219,10 +368,42 @@ bool ipc_protocol_resume(struct iosm_protocol *ipc_protocol)
 	return true;
 }
 
+void ipc_protocol_reset(struct iosm_protocol *ipc_protocol)
+{
+	struct ipc_protocol_ap_shm *p_ap_shm = ipc_protocol->p_ap_shm;
+	struct ipc_rsp *rsp;
+	int i;
+
+	/* CP will not answer the pending messages anymore. */
+	for (i = 0; i < IPC_MEM_MSG_ENTRIES; i++) {
+		if (!ipc_protocol->rsp_ring[i])
+			continue;
+
+		rsp = ipc_protocol->rsp_ring[i];
+		ipc_protocol->rsp_ring[i] = NULL;
+		ipc_protocol_rsp_complete(rsp, IPC_MEM_MSG_CS_ERROR);
+	}
+
+	/* The context info is still valid, only clear the ring state. */
+	memset(&p_ap_shm->device_info, 0, sizeof(p_ap_shm->device_info));
+	memset(p_ap_shm->head_array, 0, sizeof(p_ap_shm->head_array));
+	memset(p_ap_shm->tail_array, 0, sizeof(p_ap_shm->tail_array));
+	memset(p_ap_shm->msg_ring, 0, sizeof(p_ap_shm->msg_ring));
+	p_ap_shm->msg_head = 0;
+	p_ap_shm->msg_tail = 0;
+
+	ipc_protocol->old_msg_tail = 0;
+	memset(ipc_protocol->head_shadow, 0, sizeof(ipc_protocol->head_shadow));
+	memset(ipc_protocol->tail_shadow, 0, sizeof(ipc_protocol->tail_shadow));
+
+	ipc_pm_reset(ipc_protocol->pm);
+}
+
 struct iosm_protocol *ipc_protocol_init(struct iosm_imem *ipc_imem)
 {
 	struct iosm_protocol *ipc_protocol =
-		kzalloc(sizeof(*ipc_protocol), GFP_KERNEL);
+		kzalloc_node(sizeof(*ipc_protocol), GFP_KERNEL,
+			     dev_to_node(ipc_imem->dev));
 	struct ipc_protocol_context_info *p_ci;
 	u64 addr;
 
@@ -279,6 +460,14 @@ struct iosm_protocol *ipc_protocol_init(struct iosm_imem *ipc_imem)
 
 void ipc_protocol_deinit(struct iosm_protocol *proto)
 {
+	int i;
+
+	/* Release the asynchronous requestors CP did not answer. */
+	for (i = 0; i < IPC_MEM_MSG_ENTRIES; i++)
+		if (proto->rsp_ring[i])
+			ipc_protocol_rsp_complete(proto->rsp_ring[i],
+						  IPC_MEM_MSG_CS_ERROR);
+
 	pci_free_consistent(proto->pcie->pci, sizeof(*proto->p_ap_shm),
 			    proto->p_ap_shm, proto->phy_ap_shm);
 
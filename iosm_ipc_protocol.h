@@ -116,6 +116,9 @@ struct ipc_protocol_ap_shm {
  * @dev:		Pointer to device structure
  * @phy_ap_shm:		Physical/Mapped representation of the shared memory info
  * @old_msg_tail:	Old msg tail ptr, until AP has handled ACK's from CP
+ * @head_shadow:	Host copy of the head pointers written to head_array
+ * @tail_shadow:	Snapshot of the tail pointers written by CP, taken once
+ *			per processing round
  */
 struct iosm_protocol {
 	struct ipc_protocol_ap_shm *p_ap_shm;
@@ -126,21 +129,37 @@ struct iosm_protocol {
 	struct device *dev;
 	phys_addr_t phy_ap_shm;
 	u32 old_msg_tail;
+	u32 head_shadow[IPC_MEM_MAX_PIPES];
+	u32 tail_shadow[IPC_MEM_MAX_PIPES];
 };
 
 /**
  * struct ipc_call_msg_send_args - Structure for message argument for
  *				   tasklet function.
- * @prep_args:		Arguments for message preparation function
- * @response:		Can be NULL if result can be ignored
+ * @prep_args:		Copy of the arguments for message preparation function
+ * @response:		Response object of the requestor
  * @msg_type:		Message Type
  */
 struct ipc_call_msg_send_args {
-	union ipc_msg_prep_args *prep_args;
+	union ipc_msg_prep_args prep_args;
 	struct ipc_rsp *response;
 	enum ipc_msg_prep_type msg_type;
 };
 
+/**
+ * struct ipc_msg_batch_entry - One message of a batched send to CP.
+ * @prep_args:		Arguments for message preparation function
+ * @response:		Completion object and status of this message
+ * @msg_type:		Message Type
+ * @index:		Slot in the message ring, -1 if not queued
+ */
+struct ipc_msg_batch_entry {
+	union ipc_msg_prep_args prep_args;
+	struct ipc_rsp response;
+	enum ipc_msg_prep_type msg_type;
+	int index;
+};
+
 /**
  * ipc_protocol_tq_msg_send - prepare the msg and send to CP
  * @ipc_protocol:	Pointer to ipc_protocol instance
@@ -156,6 +175,44 @@ int ipc_protocol_tq_msg_send(struct iosm_protocol *ipc_protocol,
 			     union ipc_msg_prep_args *prep_args,
 			     struct ipc_rsp *response);
 
+/**
+ * ipc_protocol_tq_msg_send_batch - Queue several ipc control messages in the
+ *				    message ring in tasklet context and
+ *				    signal CP with a single doorbell.
+ * @ipc_protocol:	Pointer to ipc_protocol instance
+ * @entries:		Array of messages
+ * @nr:			Number of messages in @entries
+ * @track:		If true the response objects of @entries are stored
+ *			in the response ring and must stay valid until they
+ *			are completed. Else the responses of CP are ignored.
+ *
+ * Returns: Number of queued messages. The messages after them did not fit
+ *	    into the message ring and are not sent.
+ */
+int ipc_protocol_tq_msg_send_batch(struct iosm_protocol *ipc_protocol,
+				   struct ipc_msg_batch_entry *entries, int nr,
+				   bool track);
+
+/**
+ * ipc_protocol_msg_send_async - Send ipc control message to CP without
+ *				 waiting for the response.
+ * @ipc_protocol:	Pointer to ipc_protocol instance
+ * @prep:		Message type
+ * @prep_args:		Message arguments, copied before return
+ * @response:		Response object with the done callback set. It must
+ *			stay valid until done is called with the completion
+ *			status in tasklet context, or with
+ *			IPC_MEM_MSG_CS_ERROR if the task queue is freed
+ *			before the message is sent.
+ *
+ * Returns: 0 if the message is queued, -1 on failure. done is not called on
+ *	    failure.
+ */
+int ipc_protocol_msg_send_async(struct iosm_protocol *ipc_protocol,
+				enum ipc_msg_prep_type prep,
+				union ipc_msg_prep_args *prep_args,
+				struct ipc_rsp *response);
+
 /**
  * ipc_protocol_msg_send - Send ipc control message to CP and wait for response
  * @ipc_protocol:	Pointer to ipc_protocol instance
@@ -168,6 +225,41 @@ int ipc_protocol_msg_send(struct iosm_protocol *ipc_protocol,
 			  enum ipc_msg_prep_type prep,
 			  union ipc_msg_prep_args *prep_args);
 
+/**
+ * ipc_protocol_msg_send_batch_async - Queue several ipc control messages in
+ *				       the message ring and signal CP with a
+ *				       single doorbell without waiting.
+ * @ipc_protocol:	Pointer to ipc_protocol instance
+ * @entries:		Array of messages with the completion or the done
+ *			callback of every response set up. The array must
+ *			stay valid until all responses are completed.
+ * @nr:			Number of messages in @entries
+ *
+ * A message which does not fit into the message ring is completed with
+ * IPC_MEM_MSG_CS_ERROR, as is every message of the batch if the task queue
+ * is freed before the batch is sent.
+ *
+ * Returns: 0 if the batch is queued, -1 on failure. No response is
+ *	    completed on failure.
+ */
+int ipc_protocol_msg_send_batch_async(struct iosm_protocol *ipc_protocol,
+				      struct ipc_msg_batch_entry *entries,
+				      int nr);
+
+/**
+ * ipc_protocol_msg_send_batch - Queue several ipc control messages in the
+ *				 message ring, signal CP with a single
+ *				 doorbell and wait for all responses.
+ * @ipc_protocol:	Pointer to ipc_protocol instance
+ * @entries:		Array of messages. The completion status of every
+ *			message is returned in entries[i].response.status.
+ * @nr:			Number of messages in @entries
+ *
+ * Returns: 0 if all messages completed successfully, -1 otherwise
+ */
+int ipc_protocol_msg_send_batch(struct iosm_protocol *ipc_protocol,
+				struct ipc_msg_batch_entry *entries, int nr);
+
 /**
  * ipc_protocol_suspend - Signal to CP that host wants to go to sleep (suspend).
  * @ipc_protocol:	Pointer to ipc_protocol instance
@@ -222,6 +314,15 @@ void ipc_protocol_doorbell_trigger(struct iosm_protocol *ipc_protocol,
 const char *
 ipc_protocol_sleep_notification_string(struct iosm_protocol *ipc_protocol);
 
+/**
+ * ipc_protocol_reset - Bring the shared memory back to its initial state
+ *			after a modem crash. Pending requests are failed,
+ *			the message ring and the pipe indices are cleared.
+ *			The shared memory itself stays allocated and mapped.
+ * @ipc_protocol:	pointer to the IPC protocol instance
+ */
+void ipc_protocol_reset(struct iosm_protocol *ipc_protocol);
+
 /**
  * ipc_protocol_init - Allocates IPC protocol instance
  * @ipc_imem:		Pointer to iosm_imem structure
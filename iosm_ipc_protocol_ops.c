@@ -31,16 +31,24 @@ ipc_protocol_free_msg_get(struct iosm_protocol *ipc_protocol, int *index)
 	return msg;
 }
 
-/* Updates the message ring Head pointer */
-void ipc_protocol_msg_hp_update(struct iosm_imem *ipc_imem)
+/* Advances the message ring Head pointer without signalling CP */
+void ipc_protocol_msg_hp_advance(struct iosm_imem *ipc_imem)
 {
 	struct iosm_protocol *ipc_protocol = ipc_imem->ipc_protocol;
 	u32 head = ipc_protocol->p_ap_shm->msg_head;
 	u32 new_head = (head + 1) % IPC_MEM_MSG_ENTRIES;
 
-	/* Update head pointer and fire doorbell. */
 	ipc_protocol->p_ap_shm->msg_head = new_head;
 	ipc_protocol->old_msg_tail = ipc_protocol->p_ap_shm->msg_tail;
+}
+
+/* Updates the message ring Head pointer */
+void ipc_protocol_msg_hp_update(struct iosm_imem *ipc_imem)
+{
+	struct iosm_protocol *ipc_protocol = ipc_imem->ipc_protocol;
+
+	/* Update head pointer and fire doorbell. */
+	ipc_protocol_msg_hp_advance(ipc_imem);
 
 	ipc_pm_signal_hpda_doorbell(ipc_protocol->pm, IPC_HP_MR, false);
 }
@@ -64,11 +72,21 @@ static int ipc_protocol_msg_prepipe_open(struct iosm_protocol *ipc_protocol,
 		return -1;
 	}
 
+	/* Rings kept by ipc_protocol_pipe_reset() across a modem restart are
+	 * handed to CP again.
+	 */
+	if (pipe->tdr_start && pipe->skbr_start) {
+		tdr = pipe->tdr_start;
+		skbr = pipe->skbr_start;
+		goto ring_ready;
+	}
+
 	/* Allocate the skbuf elements for the skbuf which are on the way.
 	 * SKB ring is internal memory allocation for driver. No need to
 	 * re-calculate the start and end addresses.
 	 */
-	skbr = kcalloc(pipe->nr_of_entries, sizeof(*skbr), GFP_ATOMIC);
+	skbr = kcalloc_node(pipe->nr_of_entries, sizeof(*skbr), GFP_ATOMIC,
+			    dev_to_node(ipc_protocol->dev));
 	if (!skbr)
 		return -ENOMEM;
 
@@ -82,12 +100,20 @@ static int ipc_protocol_msg_prepipe_open(struct iosm_protocol *ipc_protocol,
 		return -ENOMEM;
 	}
 
+ring_ready:
+
 	pipe->max_nr_of_queued_entries = pipe->nr_of_entries - 1;
 	pipe->nr_of_queued_entries = 0;
+	pipe->nr_of_aborted_entries = 0;
+	pipe->nr_of_dl_reserve_used = 0;
+	pipe->nr_of_dl_shortfall = 0;
+	pipe->dl_shortfall_max = 0;
 	pipe->tdr_start = tdr;
 	pipe->skbr_start = skbr;
 	pipe->old_tail = 0;
 
+	ipc_protocol->head_shadow[pipe->pipe_nr] = 0;
+	ipc_protocol->tail_shadow[pipe->pipe_nr] = 0;
 	ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr] = 0;
 
 	msg->open_pipe.type_of_message = IPC_MEM_MSG_OPEN_PIPE;
@@ -123,6 +149,29 @@ static int ipc_protocol_msg_prepipe_close(struct iosm_protocol *ipc_protocol,
 	return index;
 }
 
+/* CP completes the running transfer of the pipe and returns all pending TDs
+ * with IPC_MEM_TD_CS_ABORT. The pipe stays open.
+ */
+static int ipc_protocol_msg_prepipe_abort(struct iosm_protocol *ipc_protocol,
+					  union ipc_msg_prep_args *args)
+{
+	int index = -1;
+	union ipc_mem_msg_entry *msg =
+		ipc_protocol_free_msg_get(ipc_protocol, &index);
+	struct ipc_pipe *pipe = args->pipe_abort.pipe;
+
+	if (!msg)
+		return -1;
+
+	msg->abort_pipe.type_of_message = IPC_MEM_MSG_ABORT_PIPE;
+	msg->abort_pipe.pipe_nr = pipe->pipe_nr;
+
+	dev_dbg(ipc_protocol->dev, "IPC_MEM_MSG_ABORT_PIPE(pipe_nr=%d)",
+		msg->abort_pipe.pipe_nr);
+
+	return index;
+}
+
 static int ipc_protocol_msg_prep_sleep(struct iosm_protocol *ipc_protocol,
 				       union ipc_msg_prep_args *args)
 {
@@ -169,17 +218,30 @@ static int ipc_protocol_msg_prep_feature_set(struct iosm_protocol *ipc_protocol,
 	return index;
 }
 
+void ipc_protocol_rsp_complete(struct ipc_rsp *rsp, enum ipc_mem_msg_cs status)
+{
+	rsp->status = status;
+
+	if (rsp->done)
+		rsp->done(rsp);
+	else
+		complete(&rsp->completion);
+}
+
 /* Processes the message consumed by CP. */
 bool ipc_protocol_msg_process(struct iosm_imem *ipc_imem, int irq)
 {
 	struct iosm_protocol *ipc_protocol = ipc_imem->ipc_protocol;
 	struct ipc_rsp **rsp_ring = ipc_protocol->rsp_ring;
 	bool msg_processed = false;
+	u32 msg_tail;
 	int i;
 
-	if (ipc_protocol->p_ap_shm->msg_tail >= IPC_MEM_MSG_ENTRIES) {
+	/* Take the tail once, CP may move it during the loop. */
+	msg_tail = READ_ONCE(ipc_protocol->p_ap_shm->msg_tail);
+	if (msg_tail >= IPC_MEM_MSG_ENTRIES) {
 		dev_err(ipc_protocol->dev, "msg_tail out of range: %d",
-			ipc_protocol->p_ap_shm->msg_tail);
+			msg_tail);
 		return msg_processed;
 	}
 
@@ -187,8 +249,10 @@ bool ipc_protocol_msg_process(struct iosm_imem *ipc_imem, int irq)
 	    irq != ipc_protocol->p_ap_shm->ci.msg_irq_vector)
 		return msg_processed;
 
-	for (i = ipc_protocol->old_msg_tail;
-	     i != ipc_protocol->p_ap_shm->msg_tail;
+	/* Read the completed messages only after the tail. */
+	dma_rmb();
+
+	for (i = ipc_protocol->old_msg_tail; i != msg_tail;
 	     i = (i + 1) % IPC_MEM_MSG_ENTRIES) {
 		union ipc_mem_msg_entry *msg =
 			&ipc_protocol->p_ap_shm->msg_ring[i];
@@ -199,11 +263,13 @@ bool ipc_protocol_msg_process(struct iosm_imem *ipc_imem, int irq)
 
 		/* Update response with status and wake up waiting requestor */
 		if (rsp_ring[i]) {
-			rsp_ring[i]->status =
-				(enum ipc_mem_msg_cs)
-					msg->common.completion_status;
-			complete(&rsp_ring[i]->completion);
+			struct ipc_rsp *rsp = rsp_ring[i];
+
+			/* The response object may be gone after the callback. */
 			rsp_ring[i] = NULL;
+			ipc_protocol_rsp_complete(rsp,
+						  (enum ipc_mem_msg_cs)
+						  msg->common.completion_status);
 		}
 		msg_processed = true;
 	}
@@ -234,33 +300,26 @@ bool ipc_protocol_ul_td_send(struct iosm_protocol *ipc_protocol,
 	/* Get head and tail of the td list and calculate
 	 * the number of free elements.
 	 */
-	head = ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr];
+	head = ipc_protocol->head_shadow[pipe->pipe_nr];
 	tail = pipe->old_tail;
 
-	while (!skb_queue_empty(p_ul_list)) {
-		if (head < tail)
-			free_elements = tail - head - 1;
-		else
-			free_elements =
-				pipe->nr_of_entries - head + ((s32)tail - 1);
-
-		if (free_elements <= 0) {
-			dev_dbg(ipc_protocol->dev,
-				"no free td elements for UL pipe %d",
-				pipe->pipe_nr);
-			break;
-		}
-
-		/* Get the td address. */
-		td = &pipe->tdr_start[head];
+	if (head < tail)
+		free_elements = tail - head - 1;
+	else
+		free_elements = pipe->nr_of_entries - head + ((s32)tail - 1);
 
+	/* Fill the free TDs, CP sees them once the head is published. */
+	while (free_elements > 0) {
 		/* Take the first element of the uplink list and add it
 		 * to the td list.
 		 */
 		skb = skb_dequeue(p_ul_list);
-		if (WARN_ON(!skb))
+		if (!skb)
 			break;
 
+		/* Get the td address. */
+		td = &pipe->tdr_start[head];
+
 		/* Save the reference to the uplink skbuf. */
 		pipe->skbr_start[head] = skb;
 
@@ -271,18 +330,28 @@ bool ipc_protocol_ul_td_send(struct iosm_protocol *ipc_protocol,
 		td->reserved1 = 0;
 
 		pipe->nr_of_queued_entries++;
+		free_elements--;
 
-		/* Calculate the new head and save it. */
+		/* Calculate the new head. */
 		head++;
 		if (head >= pipe->nr_of_entries)
 			head = 0;
-
-		ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr] = head;
 	}
 
+	if (!skb_queue_empty(p_ul_list))
+		dev_dbg(ipc_protocol->dev, "no free td elements for UL pipe %d",
+			pipe->pipe_nr);
+
 	if (pipe->old_head != head) {
 		dev_dbg(ipc_protocol->dev, "New UL TDs Pipe:%d", pipe->pipe_nr);
 
+		/* Order the TD writes before the head update which passes
+		 * them to CP, then publish the head once for all of them.
+		 */
+		dma_wmb();
+		ipc_protocol->head_shadow[pipe->pipe_nr] = head;
+		ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr] = head;
+
 		pipe->old_head = head;
 		/* Trigger doorbell because of pending UL packets. */
 		hpda_pending = true;
@@ -315,6 +384,10 @@ struct sk_buff *ipc_protocol_ul_td_process(struct iosm_protocol *ipc_protocol,
 		return NULL;
 	}
 
+	/* An aborted UL buffer is released like a sent one. */
+	if (p_td->scs.completion_status == IPC_MEM_TD_CS_ABORT)
+		pipe->nr_of_aborted_entries++;
+
 	return skb;
 }
 
@@ -333,8 +406,8 @@ bool ipc_protocol_dl_td_prepare(struct iosm_protocol *ipc_protocol,
 	/* Get head and tail of the td list and calculate
 	 * the number of free elements.
 	 */
-	head = ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr];
-	tail = ipc_protocol->p_ap_shm->tail_array[pipe->pipe_nr];
+	head = ipc_protocol->head_shadow[pipe->pipe_nr];
+	tail = ipc_protocol->tail_shadow[pipe->pipe_nr];
 
 	new_head = head + 1;
 	if (new_head >= pipe->nr_of_entries)
@@ -350,8 +423,16 @@ bool ipc_protocol_dl_td_prepare(struct iosm_protocol *ipc_protocol,
 	skb = ipc_pcie_alloc_skb(ipc_protocol->pcie, pipe->buf_size, GFP_ATOMIC,
 				 &mapping, DMA_FROM_DEVICE,
 				 IPC_MEM_DL_ETH_OFFSET);
-	if (!skb)
-		return false;
+	if (!skb) {
+		/* Fall back to the premapped reserve of the pipe. */
+		if (!pipe->nr_of_dl_reserve)
+			return false;
+
+		skb = pipe->dl_reserve[--pipe->nr_of_dl_reserve];
+		pipe->dl_reserve[pipe->nr_of_dl_reserve] = NULL;
+		mapping = IPC_CB(skb)->mapping;
+		pipe->nr_of_dl_reserve_used++;
+	}
 
 	td->buffer.address = mapping;
 	td->scs.size = pipe->buf_size;
@@ -359,7 +440,9 @@ bool ipc_protocol_dl_td_prepare(struct iosm_protocol *ipc_protocol,
 	td->next = 0;
 	td->reserved1 = 0;
 
-	/* store the new head value. */
+	/* store the new head value after the TD. */
+	dma_wmb();
+	ipc_protocol->head_shadow[pipe->pipe_nr] = new_head;
 	ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr] = new_head;
 
 	/* Save the reference to the skbuf. */
@@ -370,13 +453,95 @@ bool ipc_protocol_dl_td_prepare(struct iosm_protocol *ipc_protocol,
 	return true;
 }
 
+void ipc_protocol_dl_reserve_fill(struct iosm_protocol *ipc_protocol,
+				  struct ipc_pipe *pipe)
+{
+	dma_addr_t mapping = 0;
+	struct sk_buff *skb;
+
+	while (pipe->nr_of_dl_reserve < IPC_MEM_DL_RESERVE_SIZE) {
+		skb = ipc_pcie_alloc_skb(ipc_protocol->pcie, pipe->buf_size,
+					 GFP_ATOMIC, &mapping, DMA_FROM_DEVICE,
+					 IPC_MEM_DL_ETH_OFFSET);
+		if (!skb)
+			break;
+
+		pipe->dl_reserve[pipe->nr_of_dl_reserve++] = skb;
+	}
+}
+
+/* Drop the DL frame in reassembly. */
+static void ipc_protocol_dl_frame_drop(struct ipc_pipe *pipe)
+{
+	/* The pieces are unmapped, the frag_list goes with the frame. */
+	dev_kfree_skb(pipe->dl_frame);
+	pipe->dl_frame = NULL;
+	pipe->dl_frame_last = NULL;
+}
+
+/* Chain a piece of a DL frame which spans several TDs. Returns the frame
+ * with its last piece, else NULL.
+ */
+static struct sk_buff *
+ipc_protocol_dl_frame_add(struct iosm_protocol *ipc_protocol,
+			  struct ipc_pipe *pipe, struct sk_buff *skb, bool more)
+{
+	struct sk_buff *frame = pipe->dl_frame;
+
+	/* The frame is passed on as a whole, give the pieces back to the CPU
+	 * now.
+	 */
+	ipc_pcie_addr_unmap(ipc_protocol->pcie, IPC_CB(skb)->len,
+			    IPC_CB(skb)->mapping, IPC_CB(skb)->direction);
+	IPC_CB(skb)->mapping = 0;
+
+	if (frame && frame->len + skb->len > IPC_MEM_MAX_DL_FRAME_SIZE) {
+		dev_err(ipc_protocol->dev, "pipe %d: DL frame exceeds %d bytes",
+			pipe->pipe_nr, IPC_MEM_MAX_DL_FRAME_SIZE);
+		ipc_protocol_dl_frame_drop(pipe);
+		pipe->dl_frame_discard = true;
+	}
+
+	if (pipe->dl_frame_discard) {
+		dev_kfree_skb(skb);
+		pipe->dl_frame_discard = more;
+		return NULL;
+	}
+
+	if (!frame) {
+		pipe->dl_frame = skb;
+	} else {
+		/* Zero-copy: the piece keeps its buffer. */
+		if (pipe->dl_frame_last)
+			pipe->dl_frame_last->next = skb;
+		else
+			skb_shinfo(frame)->frag_list = skb;
+
+		pipe->dl_frame_last = skb;
+		frame->len += skb->len;
+		frame->data_len += skb->len;
+		frame->truesize += skb->truesize;
+	}
+
+	if (more)
+		return NULL;
+
+	frame = pipe->dl_frame;
+	pipe->dl_frame = NULL;
+	pipe->dl_frame_last = NULL;
+
+	return frame;
+}
+
 /* Processes DL TD's */
 struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 					   struct ipc_pipe *pipe)
 {
-	u32 tail = ipc_protocol->p_ap_shm->tail_array[pipe->pipe_nr];
+	u32 tail = ipc_protocol->tail_shadow[pipe->pipe_nr];
 	struct ipc_protocol_td *p_td;
 	struct sk_buff *skb;
+	enum ipc_mem_td_cs status;
+	bool more;
 
 	if (!pipe->tdr_start)
 		return NULL;
@@ -396,12 +561,12 @@ struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 
 	if (!skb) {
 		dev_err(ipc_protocol->dev, "skb is null");
-		goto ret;
+		goto drop;
 	} else if (!p_td->buffer.address) {
 		dev_err(ipc_protocol->dev, "td/buffer address is null");
 		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
 		skb = NULL;
-		goto ret;
+		goto drop;
 	}
 
 	if (!IPC_CB(skb)) {
@@ -409,7 +574,7 @@ struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 			pipe->pipe_nr, tail);
 		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
 		skb = NULL;
-		goto ret;
+		goto drop;
 	}
 
 	if (p_td->buffer.address != IPC_CB(skb)->mapping) {
@@ -417,26 +582,42 @@ struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 			(void *)p_td->buffer.address, skb->data);
 		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
 		skb = NULL;
-		goto ret;
+		goto drop;
 	} else if (p_td->scs.size > pipe->buf_size) {
 		dev_err(ipc_protocol->dev, "invalid buffer size %d > %d",
 			p_td->scs.size, pipe->buf_size);
 		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
 		skb = NULL;
-		goto ret;
+		goto drop;
 	} else if (p_td->scs.completion_status == IPC_MEM_TD_CS_ABORT) {
 		/* Discard aborted buffers. */
 		dev_dbg(ipc_protocol->dev, "discard 'aborted' buffers");
+		pipe->nr_of_aborted_entries++;
 		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
 		skb = NULL;
-		goto ret;
+		goto drop;
 	}
 
 	/* Set the length field in skbuf. */
 	skb_put(skb, p_td->scs.size);
 
-ret:
+	/* A frame larger than the buffer spans several TDs. */
+	more = p_td->scs.completion_status == IPC_MEM_TD_CS_PARTIAL_TRANSFER;
+	if (more || pipe->dl_frame || pipe->dl_frame_discard)
+		skb = ipc_protocol_dl_frame_add(ipc_protocol, pipe, skb, more);
+
 	return skb;
+
+drop:
+	/* The frame in reassembly is incomplete. Its remaining pieces are
+	 * skipped unless the failed TD was the last one.
+	 */
+	status = p_td->scs.completion_status;
+	pipe->dl_frame_discard = status == IPC_MEM_TD_CS_PARTIAL_TRANSFER ||
+				 ((pipe->dl_frame || pipe->dl_frame_discard) &&
+				  status != IPC_MEM_TD_CS_END_TRANSFER);
+	ipc_protocol_dl_frame_drop(pipe);
+	return NULL;
 }
 
 void ipc_protocol_get_head_tail_index(struct iosm_protocol *ipc_protocol,
@@ -444,27 +625,48 @@ void ipc_protocol_get_head_tail_index(struct iosm_protocol *ipc_protocol,
 				      u32 *tail)
 {
 	if (head)
-		*head = ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr];
+		*head = ipc_protocol->head_shadow[pipe->pipe_nr];
 
 	if (tail)
-		*tail = ipc_protocol->p_ap_shm->tail_array[pipe->pipe_nr];
+		*tail = ipc_protocol->tail_shadow[pipe->pipe_nr];
 }
 
-/* Frees the TDs given to CP.  */
-void ipc_protocol_pipe_cleanup(struct iosm_protocol *ipc_protocol,
-			       struct ipc_pipe *pipe)
+u32 ipc_protocol_read_tail_index(struct iosm_protocol *ipc_protocol,
+				 struct ipc_pipe *pipe)
+{
+	return READ_ONCE(ipc_protocol->p_ap_shm->tail_array[pipe->pipe_nr]);
+}
+
+void ipc_protocol_tail_snapshot(struct iosm_protocol *ipc_protocol)
+{
+	struct ipc_protocol_ap_shm *p_ap_shm = ipc_protocol->p_ap_shm;
+	int i;
+
+	for (i = 0; i < IPC_MEM_MAX_PIPES; i++)
+		ipc_protocol->tail_shadow[i] =
+			READ_ONCE(p_ap_shm->tail_array[i]);
+
+	/* Read the TDs returned by CP only after their tail pointer. */
+	dma_rmb();
+}
+
+/* Free the buffers still on the way and reset the pipe indices. */
+static void ipc_protocol_pipe_skbs_free(struct iosm_protocol *ipc_protocol,
+					struct ipc_pipe *pipe)
 {
 	struct sk_buff *skb;
 	u32 head;
 	u32 tail;
 
 	/* Get the start and the end of the buffer list. */
-	head = ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr];
+	head = ipc_protocol->head_shadow[pipe->pipe_nr];
 	tail = pipe->old_tail;
 
 	/* Reset tail and head to 0. */
 	ipc_protocol->p_ap_shm->tail_array[pipe->pipe_nr] = 0;
 	ipc_protocol->p_ap_shm->head_array[pipe->pipe_nr] = 0;
+	ipc_protocol->head_shadow[pipe->pipe_nr] = 0;
+	ipc_protocol->tail_shadow[pipe->pipe_nr] = 0;
 
 	/* Free pending uplink and downlink buffers. */
 	if (pipe->skbr_start) {
@@ -480,13 +682,47 @@ void ipc_protocol_pipe_cleanup(struct iosm_protocol *ipc_protocol,
 			if (tail >= pipe->nr_of_entries)
 				tail = 0;
 		}
-
-		kfree(pipe->skbr_start);
-		pipe->skbr_start = NULL;
 	}
 
 	pipe->old_tail = 0;
 
+	ipc_protocol_dl_frame_drop(pipe);
+	pipe->dl_frame_discard = false;
+
+	/* The reserve matches the buffer size of this opening. */
+	while (pipe->nr_of_dl_reserve) {
+		skb = pipe->dl_reserve[--pipe->nr_of_dl_reserve];
+		pipe->dl_reserve[pipe->nr_of_dl_reserve] = NULL;
+		ipc_pcie_kfree_skb(ipc_protocol->pcie, skb);
+	}
+}
+
+void ipc_protocol_pipe_reset(struct iosm_protocol *ipc_protocol,
+			     struct ipc_pipe *pipe)
+{
+	ipc_protocol_pipe_skbs_free(ipc_protocol, pipe);
+
+	pipe->old_head = 0;
+	pipe->nr_of_queued_entries = 0;
+
+	/* Keep the rings, they are reused by the next OPEN_PIPE. */
+	if (pipe->skbr_start)
+		memset(pipe->skbr_start, 0,
+		       pipe->nr_of_entries * sizeof(*pipe->skbr_start));
+
+	if (pipe->tdr_start)
+		memset(pipe->tdr_start, 0,
+		       pipe->nr_of_entries * sizeof(*pipe->tdr_start));
+}
+
+void ipc_protocol_pipe_cleanup(struct iosm_protocol *ipc_protocol,
+			       struct ipc_pipe *pipe)
+{
+	ipc_protocol_pipe_skbs_free(ipc_protocol, pipe);
+
+	kfree(pipe->skbr_start);
+	pipe->skbr_start = NULL;
+
 	/* Free and reset the td and skbuf circular buffers. kfree is save! */
 	if (pipe->tdr_start) {
 		pci_free_consistent(ipc_protocol->pcie->pci,
@@ -527,12 +763,21 @@ int ipc_protocol_msg_prep(struct iosm_imem *ipc_imem,
 	case IPC_MSG_PREP_PIPE_CLOSE:
 		return ipc_protocol_msg_prepipe_close(ipc_protocol, args);
 
+	case IPC_MSG_PREP_PIPE_ABORT:
+		return ipc_protocol_msg_prepipe_abort(ipc_protocol, args);
+
 	case IPC_MSG_PREP_FEATURE_SET:
 		return ipc_protocol_msg_prep_feature_set(ipc_protocol, args);
 
-		/* Unsupported messages in protocol */
+	/* The message ring of CP has no message for the region mapping,
+	 * see enum ipc_mem_msg.
+	 */
 	case IPC_MSG_PREP_MAP:
 	case IPC_MSG_PREP_UNMAP:
+		dev_dbg(ipc_protocol->dev, "msg type %d not supported by CP",
+			msg_type);
+		return -EOPNOTSUPP;
+
 	default:
 		dev_err(ipc_protocol->dev,
 			"unsupported message type: %d in protocol", msg_type);
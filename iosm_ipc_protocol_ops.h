@@ -41,7 +41,7 @@ enum ipc_mem_msg_cs {
 
 /**
  * struct ipc_msg_prep_args_pipe - struct for pipe args for message preparation
- * @pipe:	Pipe to open/close
+ * @pipe:	Pipe to open/close/abort
  */
 struct ipc_msg_prep_args_pipe {
 	struct ipc_pipe *pipe;
@@ -91,6 +91,7 @@ struct ipc_msg_prep_unmap {
  * struct ipc_msg_prep_args - Union to handle different message types
  * @pipe_open:		Pipe open message preparation struct
  * @pipe_close:		Pipe close message preparation struct
+ * @pipe_abort:		Pipe abort message preparation struct
  * @sleep:		Sleep message preparation struct
  * @feature_set:	Feature set message preparation struct
  * @map:		Memory map message preparation struct
@@ -99,6 +100,7 @@ struct ipc_msg_prep_unmap {
 union ipc_msg_prep_args {
 	struct ipc_msg_prep_args_pipe pipe_open;
 	struct ipc_msg_prep_args_pipe pipe_close;
+	struct ipc_msg_prep_args_pipe pipe_abort;
 	struct ipc_msg_prep_args_sleep sleep;
 	struct ipc_msg_prep_feature_set feature_set;
 	struct ipc_msg_prep_map map;
@@ -110,14 +112,18 @@ union ipc_msg_prep_args {
  * @IPC_MSG_PREP_SLEEP:		Sleep message preparation type
  * @IPC_MSG_PREP_PIPE_OPEN:	Pipe open message preparation type
  * @IPC_MSG_PREP_PIPE_CLOSE:	Pipe close message preparation type
+ * @IPC_MSG_PREP_PIPE_ABORT:	Pipe abort message preparation type
  * @IPC_MSG_PREP_FEATURE_SET:	Feature set message preparation type
- * @IPC_MSG_PREP_MAP:		Memory map message preparation type
- * @IPC_MSG_PREP_UNMAP:		Memory unmap message preparation type
+ * @IPC_MSG_PREP_MAP:		Memory map message preparation type, not
+ *				supported by the CP message ring
+ * @IPC_MSG_PREP_UNMAP:		Memory unmap message preparation type, not
+ *				supported by the CP message ring
  */
 enum ipc_msg_prep_type {
 	IPC_MSG_PREP_SLEEP,
 	IPC_MSG_PREP_PIPE_OPEN,
 	IPC_MSG_PREP_PIPE_CLOSE,
+	IPC_MSG_PREP_PIPE_ABORT,
 	IPC_MSG_PREP_FEATURE_SET,
 	IPC_MSG_PREP_MAP,
 	IPC_MSG_PREP_UNMAP,
@@ -125,11 +131,14 @@ enum ipc_msg_prep_type {
 
 /**
  * struct ipc_rsp - Response to sent message
- * @completion:	For waking up requestor
+ * @completion:	For waking up requestor if done is NULL
+ * @done:	Called in tasklet context with the status set, replaces the
+ *		completion for asynchronous requestors
  * @status:	Completion status
  */
 struct ipc_rsp {
 	struct completion completion;
+	void (*done)(struct ipc_rsp *rsp);
 	enum ipc_mem_msg_cs status;
 };
 
@@ -342,12 +351,23 @@ struct ipc_protocol_td {
  * @msg_type:	message prepare type
  * @args:	message arguments
  *
- * Return: 0 on success, -1 in case of failure
+ * Return: index of the message in the ring on success, -EOPNOTSUPP for a
+ *	   message type without CP support, other negative value in case of
+ *	   failure
  */
 int ipc_protocol_msg_prep(struct iosm_imem *ipc_imem,
 			  enum ipc_msg_prep_type msg_type,
 			  union ipc_msg_prep_args *args);
 
+/**
+ * ipc_protocol_msg_hp_advance - Move the head pointer of the message ring
+ *				 past the last prepared message without
+ *				 ringing the doorbell. Used to queue several
+ *				 messages behind a single doorbell.
+ * @ipc_imem:	iosm_protocol instance
+ */
+void ipc_protocol_msg_hp_advance(struct iosm_imem *ipc_imem);
+
 /**
  * ipc_protocol_msg_hp_update - Function for head pointer update
  *				of message ring
@@ -355,6 +375,14 @@ int ipc_protocol_msg_prep(struct iosm_imem *ipc_imem,
  */
 void ipc_protocol_msg_hp_update(struct iosm_imem *ipc_imem);
 
+/**
+ * ipc_protocol_rsp_complete - Set the completion status of a message and
+ *			       notify its requestor.
+ * @rsp:	Response object of the message
+ * @status:	Completion status
+ */
+void ipc_protocol_rsp_complete(struct ipc_rsp *rsp, enum ipc_mem_msg_cs status);
+
 /**
  * ipc_protocol_msg_process - Function for processing responses
  *			      to IPC messages
@@ -397,6 +425,15 @@ struct sk_buff *ipc_protocol_ul_td_process(struct iosm_protocol *ipc_protocol,
 bool ipc_protocol_dl_td_prepare(struct iosm_protocol *ipc_protocol,
 				struct ipc_pipe *pipe);
 
+/**
+ * ipc_protocol_dl_reserve_fill - Top up the premapped DL buffer reserve of a
+ *				  pipe. Stops at the first failed allocation.
+ * @ipc_protocol:	iosm_protocol instance
+ * @pipe:		Pipe instance
+ */
+void ipc_protocol_dl_reserve_fill(struct iosm_protocol *ipc_protocol,
+				  struct ipc_pipe *pipe);
+
 /**
  * ipc_protocol_dl_td_process - Function for processing the DL data
  * @ipc_protocol:	iosm_protocol instance
@@ -409,7 +446,9 @@ struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 
 /**
  * ipc_protocol_get_head_tail_index - Function for getting Head and Tail
- *				      pointer index of given pipe
+ *				      pointer index of given pipe. The head is
+ *				      the host copy, the tail is taken from the
+ *				      snapshot of the processing round.
  * @ipc_protocol:	iosm_protocol instance
  * @pipe:		Pipe Instance
  * @head:		head pointer index of the given pipe
@@ -418,6 +457,26 @@ struct sk_buff *ipc_protocol_dl_td_process(struct iosm_protocol *ipc_protocol,
 void ipc_protocol_get_head_tail_index(struct iosm_protocol *ipc_protocol,
 				      struct ipc_pipe *pipe, u32 *head,
 				      u32 *tail);
+
+/**
+ * ipc_protocol_read_tail_index - Read the tail pointer index of a pipe from
+ *				  the shared memory instead of the snapshot.
+ * @ipc_protocol:	iosm_protocol instance
+ * @pipe:		Pipe Instance
+ *
+ * Returns: tail pointer index written by CP
+ */
+u32 ipc_protocol_read_tail_index(struct iosm_protocol *ipc_protocol,
+				 struct ipc_pipe *pipe);
+
+/**
+ * ipc_protocol_tail_snapshot - Copy the tail pointers written by CP into the
+ *				host snapshot. Called once per processing round
+ *				in tasklet context, the TD processing uses the
+ *				snapshot.
+ * @ipc_protocol:	iosm_protocol instance
+ */
+void ipc_protocol_tail_snapshot(struct iosm_protocol *ipc_protocol);
 /**
  * ipc_protocol_get_ipc_status - Function for getting the IPC Status
  * @ipc_protocol:	iosm_protocol instance
@@ -427,6 +486,16 @@ void ipc_protocol_get_head_tail_index(struct iosm_protocol *ipc_protocol,
 enum ipc_mem_device_ipc_state ipc_protocol_get_ipc_status(struct iosm_protocol
 							  *ipc_protocol);
 
+/**
+ * ipc_protocol_pipe_reset - Free the buffers on the way and reset the pipe
+ *			     indices, but keep the TD and skbuf rings
+ *			     allocated for a later reopen of the pipe.
+ * @ipc_protocol:	iosm_protocol instance
+ * @pipe:		Pipe instance
+ */
+void ipc_protocol_pipe_reset(struct iosm_protocol *ipc_protocol,
+			     struct ipc_pipe *pipe);
+
 /**
  * ipc_protocol_pipe_cleanup - Function to cleanup pipe resources
  * @ipc_protocol:	iosm_protocol instance
@@ -8,9 +8,6 @@
 
 #include "iosm_ipc_sio.h"
 
-static struct mutex sio_floc;		/* Mutex Lock for sio read */
-static struct mutex sio_floc_wr;	/* Mutex Lock for sio write */
-
 /* Open a shared memory device and initialize the head of the rx skbuf list. */
 static int ipc_sio_fop_open(struct inode *inode, struct file *filp)
 {
@@ -34,31 +31,37 @@ static int ipc_sio_fop_open(struct inode *inode, struct file *filp)
 		return -EIO;
 	}
 
-	mutex_lock(&sio_floc);
+	/* The open file keeps the instance and its locks alive. */
+	kref_get(&ipc_sio->kref);
+
+	mutex_lock(&ipc_sio->floc);
 
 	inode->i_private = sio_op;
 	ipc_sio->sio_fop = sio_op;
 	sio_op->sio_dev = ipc_sio;
 
-	mutex_unlock(&sio_floc);
+	mutex_unlock(&ipc_sio->floc);
 	return 0;
 }
 
 static int ipc_sio_fop_release(struct inode *inode, struct file *filp)
 {
 	struct iosm_sio_open_file *sio_op = inode->i_private;
+	struct iosm_sio *ipc_sio = sio_op->sio_dev;
 
-	mutex_lock(&sio_floc);
+	mutex_lock(&ipc_sio->floc);
 
-	if (sio_op->sio_dev) {
-		clear_bit(IS_OPEN, &sio_op->sio_dev->flag);
-		imem_sys_sio_close(sio_op->sio_dev);
-		sio_op->sio_dev->sio_fop = NULL;
+	if (!test_bit(IS_DEINIT, &ipc_sio->flag)) {
+		clear_bit(IS_OPEN, &ipc_sio->flag);
+		imem_sys_sio_close(ipc_sio);
+		ipc_sio->sio_fop = NULL;
 	}
 
 	kfree(sio_op);
 
-	mutex_unlock(&sio_floc);
+	mutex_unlock(&ipc_sio->floc);
+
+	ipc_sio_put(ipc_sio);
 	return 0;
 }
 
@@ -77,15 +80,15 @@ static ssize_t ipc_sio_fop_read(struct file *filp, char __user *buf,
 		goto err;
 	}
 
-	mutex_lock(&sio_floc);
+	ipc_sio = sio_op->sio_dev;
+
+	mutex_lock(&ipc_sio->floc);
 
-	if (!sio_op->sio_dev) {
+	if (test_bit(IS_DEINIT, &ipc_sio->flag)) {
 		ret_err = -EIO;
 		goto err_free_lock;
 	}
 
-	ipc_sio = sio_op->sio_dev;
-
 	if (!(filp->f_flags & O_NONBLOCK))
 		set_bit(IS_BLOCKING, &ipc_sio->flag);
 
@@ -121,11 +124,11 @@ static ssize_t ipc_sio_fop_read(struct file *filp, char __user *buf,
 	}
 
 	read_byt = imem_sys_sio_read(ipc_sio, buf, size, skb);
-	mutex_unlock(&sio_floc);
+	mutex_unlock(&ipc_sio->floc);
 	return read_byt;
 
 err_free_lock:
-	mutex_unlock(&sio_floc);
+	mutex_unlock(&ipc_sio->floc);
 err:
 	return ret_err;
 }
@@ -145,14 +148,14 @@ static ssize_t ipc_sio_fop_write(struct file *filp, const char __user *buf,
 		goto err;
 	}
 
-	mutex_lock(&sio_floc_wr);
-	if (!sio_op->sio_dev) {
+	ipc_sio = sio_op->sio_dev;
+
+	mutex_lock(&ipc_sio->floc_wr);
+	if (test_bit(IS_DEINIT, &ipc_sio->flag)) {
 		ret_err = -EIO;
 		goto err_free_lock;
 	}
 
-	ipc_sio = sio_op->sio_dev;
-
 	is_blocking = !(filp->f_flags & O_NONBLOCK);
 	if (!is_blocking) {
 		if (test_bit(WRITE_IN_USE, &ipc_sio->flag)) {
@@ -162,11 +165,11 @@ static ssize_t ipc_sio_fop_write(struct file *filp, const char __user *buf,
 	}
 
 	write_byt =  imem_sys_sio_write(ipc_sio, buf, size, is_blocking);
-	mutex_unlock(&sio_floc_wr);
+	mutex_unlock(&ipc_sio->floc_wr);
 	return write_byt;
 
 err_free_lock:
-	mutex_unlock(&sio_floc_wr);
+	mutex_unlock(&ipc_sio->floc_wr);
 err:
 	return ret_err;
 }
@@ -211,8 +214,9 @@ struct iosm_sio *ipc_sio_init(struct iosm_imem *ipc_imem, const char *name)
 	ipc_sio->pcie = ipc_imem->pcie;
 	ipc_sio->ipc_imem = ipc_imem;
 
-	mutex_init(&sio_floc);
-	mutex_init(&sio_floc_wr);
+	mutex_init(&ipc_sio->floc);
+	mutex_init(&ipc_sio->floc_wr);
+	kref_init(&ipc_sio->kref);
 	init_completion(&ipc_sio->read_sem);
 
 	skb_queue_head_init(&ipc_sio->rx_list);
@@ -249,18 +253,28 @@ void ipc_sio_deinit(struct iosm_sio *ipc_sio)
 			complete(&ipc_sio->channel->ul_sem);
 		}
 
-		mutex_lock(&sio_floc);
-		mutex_lock(&sio_floc_wr);
+		mutex_lock(&ipc_sio->floc);
+		mutex_lock(&ipc_sio->floc_wr);
 
 		ipc_pcie_kfree_skb(ipc_sio->pcie, ipc_sio->rx_pending_buf);
+		ipc_sio->rx_pending_buf = NULL;
 		skb_queue_purge(&ipc_sio->rx_list);
 
-		if (ipc_sio->sio_fop)
-			ipc_sio->sio_fop->sio_dev = NULL;
+		ipc_sio->sio_fop = NULL;
 
-		mutex_unlock(&sio_floc_wr);
-		mutex_unlock(&sio_floc);
+		mutex_unlock(&ipc_sio->floc_wr);
+		mutex_unlock(&ipc_sio->floc);
 
-		kfree(ipc_sio);
+		ipc_sio_put(ipc_sio);
 	}
 }
+
+static void ipc_sio_release(struct kref *kref)
+{
+	kfree(container_of(kref, struct iosm_sio, kref));
+}
+
+void ipc_sio_put(struct iosm_sio *ipc_sio)
+{
+	kref_put(&ipc_sio->kref, ipc_sio_release);
+}
@@ -6,6 +6,7 @@
 #ifndef IOSM_IPC_SIO_H
 #define IOSM_IPC_SIO_H
 
+#include <linux/kref.h>
 #include <linux/miscdevice.h>
 #include <linux/skbuff.h>
 
@@ -43,6 +44,10 @@ struct iosm_sio_open_file {
  * @poll_inq:		Read queues to support the poll system call
  * @flag:		Flags to monitor state of device
  * @wmaxcommand:	Max buffer size
+ * @floc:		Mutex Lock for the read path and the open file
+ * @floc_wr:		Mutex Lock for the write path
+ * @kref:		Held by the device and by the open file, so that
+ *			the locks stay valid until the last user is gone
  */
 struct iosm_sio {
 	struct miscdevice misc;
@@ -58,6 +63,9 @@ struct iosm_sio {
 	wait_queue_head_t poll_inq;
 	unsigned long flag;
 	u16 wmaxcommand;
+	struct mutex floc;
+	struct mutex floc_wr;
+	struct kref kref;
 };
 
 /**
@@ -75,4 +83,11 @@ struct iosm_sio *ipc_sio_init(struct iosm_imem *ipc_imem, const char *name);
  */
 void ipc_sio_deinit(struct iosm_sio *ipc_sio);
 
+/**
+ * ipc_sio_put - Drop a reference to a sio or mbim instance and free it with
+ *		 the last one.
+ * @ipc_sio:	Pointer to the ipc sio data-struct
+ */
+void ipc_sio_put(struct iosm_sio *ipc_sio);
+
 #endif
@@ -3,197 +3,521 @@
  * Copyright (C) 2020 Intel Corporation.
  */
 
+#include <linux/debugfs.h>
+#include <linux/hash.h>
 #include <linux/slab.h>
 
 #include "iosm_ipc_task_queue.h"
 
-/* Number of available element for the input message queue of the IPC
- * ipc_task.
+#define CREATE_TRACE_POINTS
+#include "iosm_ipc_trace.h"
+
+/* Number of elements of the lanes of the task queue. Must be a power of 2.
+ * The data lane takes the bursts of the packet path.
+ */
+#define IPC_TASK_QUEUE_DATA_SIZE 256
+#define IPC_TASK_QUEUE_CTRL_SIZE 64
+
+/* A message up to this size is copied into the queue element, a larger one
+ * into heap memory.
+ */
+#define IPC_TASK_QUEUE_INLINE_SIZE 64
+
+/* Budget of one tasklet run: number of tasks and time. The tasklet schedules
+ * itself again once the budget is exhausted.
  */
-#define IPC_THREAD_QUEUE_SIZE 256
+#define IPC_TASK_QUEUE_BUDGET 64
+#define IPC_TASK_QUEUE_BUDGET_USECS 2000
+
+/* Number of task functions with statistics. Must be a power of 2. */
+#define IPC_TASK_QUEUE_STATS_BITS 5
+#define IPC_TASK_QUEUE_STATS BIT(IPC_TASK_QUEUE_STATS_BITS)
 
 /**
  * struct ipc_task_queue_args - Struct for Task queue elements
+ * @seq:	Sequence number of the element. Equal to the queue position if
+ *		the element is free, position + 1 if it is ready to process.
  * @instance:	Instance pointer for function to be called in tasklet context
  * @msg:	Message argument for tasklet function. (optional, can be NULL)
- * @completion:	OS object used to wait for the tasklet function to finish for
- *		synchronous calls
  * @func:	Function to be called in tasklet (tl) context
+ * @done:	Completion callback, gets arg and the return code of func
+ *		(optional)
+ * @done_ctx:	Context argument for done
  * @arg:	Generic integer argument for tasklet function (optional)
  * @size:	Message size argument for tasklet function (optional)
- * @response:	Return code of tasklet function for synchronous calls
+ * @enqueue_ns:	Time of the enqueue
  * @is_copy:	Is true if msg contains a pointer to a copy of the original msg
  *		for async. calls that needs to be freed once the tasklet returns
+ * @data:	Inline copy of a small message, msg points to it
  */
 struct ipc_task_queue_args {
+	unsigned int seq;
 	void *instance;
 	void *msg;
-	struct completion *completion;
 	int (*func)(struct iosm_imem *ipc_imem, int arg, void *msg,
 		    size_t size);
+	void (*done)(struct iosm_imem *ipc_imem, int arg, int response,
+		     void *ctx);
+	void *done_ctx;
 	int arg;
 	size_t size;
-	int response;
+	u64 enqueue_ns;
 	u8 is_copy : 1;
+	u8 data[IPC_TASK_QUEUE_INLINE_SIZE] __aligned(sizeof(u64));
+};
+
+/**
+ * struct ipc_task_queue_event - Handler of an idempotent event
+ * @func:	Function to be called in tasklet context
+ * @instance:	Instance pointer for func
+ * @arg:	Integer argument for func
+ * @enqueue_ns:	Time the event was set
+ */
+struct ipc_task_queue_event {
+	int (*func)(struct iosm_imem *ipc_imem, int arg, void *msg,
+		    size_t size);
+	void *instance;
+	int arg;
+	u64 enqueue_ns;
+};
+
+/**
+ * struct ipc_task_stat - Statistics of a task function, updated by the tasklet
+ * @func:	Task function, NULL if the entry is free
+ * @count:	Number of calls
+ * @wait_ns:	Sum of the times from enqueue to start
+ * @wait_max_ns:	Longest time from enqueue to start
+ * @run_ns:	Sum of the run times
+ * @run_max_ns:	Longest run time
+ */
+struct ipc_task_stat {
+	const void *func;
+	u64 count;
+	u64 wait_ns;
+	u64 wait_max_ns;
+	u64 run_ns;
+	u64 run_max_ns;
+};
+
+/**
+ * struct ipc_task_lane - Lock-free MPSC ring of one task queue lane
+ * @args:	Queue elements
+ * @mask:	Number of elements - 1
+ * @q_rpos:	First queue element to process, only written by the tasklet.
+ * @q_wpos:	Next queue element to reserve by a producer.
+ * @depth_max:	Highest number of tasks in the lane seen by the tasklet
+ * @nr_retries:	Number of lost races for a queue element
+ * @nr_full:	Number of tasks rejected on a full lane
+ */
+struct ipc_task_lane {
+	struct ipc_task_queue_args *args;
+	unsigned int mask;
+	unsigned int q_rpos;
+	unsigned int depth_max;
+	atomic_t q_wpos ____cacheline_aligned_in_smp;
+	atomic_t nr_retries;
+	atomic_t nr_full;
 };
 
 /**
  * struct ipc_task_queue - Struct for Task queue
  * @dev:	pointer to device structure
- * @q_lock:	Protect the message queue of the ipc ipc_task
- * @args:	Message queue of the IPC ipc_task
- * @q_rpos:	First queue element to process.
- * @q_wpos:	First free element of the input queue.
+ * @tasklet:	Tasklet which processes the queue
+ * @nr_budget_tasks:	Number of runs stopped by the task budget
+ * @nr_budget_time:	Number of runs stopped by the time budget
+ * @events:	Pending events
+ * @event_fn:	Handlers of the events
+ * @dbg_dir:	debugfs directory of the statistics
+ * @stats:	Statistics of the task functions, hashed by function
+ * @lane:	Message queues of the IPC ipc_task, one per lane
  */
 struct ipc_task_queue {
 	struct device *dev;
-	spinlock_t q_lock; /* for atomic operation on queue */
-	struct ipc_task_queue_args args[IPC_THREAD_QUEUE_SIZE];
-	unsigned int q_rpos;
-	unsigned int q_wpos;
+	struct tasklet_struct *tasklet;
+	unsigned int nr_budget_tasks;
+	unsigned int nr_budget_time;
+	DECLARE_BITMAP(events, IPC_TASK_EV_MAX);
+	struct ipc_task_queue_event event_fn[IPC_TASK_EV_MAX];
+	struct dentry *dbg_dir;
+	struct ipc_task_stat stats[IPC_TASK_QUEUE_STATS];
+	struct ipc_task_lane lane[IPC_TASK_LANE_MAX];
 };
 
+/**
+ * struct ipc_task_queue_wait - Waiter of a synchronous call
+ * @completion:	Completed after the tasklet function has returned
+ * @response:	Return code of the tasklet function
+ */
+struct ipc_task_queue_wait {
+	struct completion completion;
+	int response;
+};
+
+static const char *const ipc_task_lane_name[IPC_TASK_LANE_MAX] = {
+	[IPC_TASK_LANE_DATA] = "data",
+	[IPC_TASK_LANE_CTRL] = "ctrl",
+};
+
+static const unsigned int ipc_task_lane_size[IPC_TASK_LANE_MAX] = {
+	[IPC_TASK_LANE_DATA] = IPC_TASK_QUEUE_DATA_SIZE,
+	[IPC_TASK_LANE_CTRL] = IPC_TASK_QUEUE_CTRL_SIZE,
+};
+
+/* Find or add the statistics entry of a task function. Returns NULL if the
+ * table is full.
+ */
+static struct ipc_task_stat *ipc_task_stat_get(struct ipc_task_queue *ipc_task,
+					       const void *func)
+{
+	unsigned int slot = hash_ptr(func, IPC_TASK_QUEUE_STATS_BITS);
+	struct ipc_task_stat *stat;
+	int i;
+
+	for (i = 0; i < IPC_TASK_QUEUE_STATS; i++, slot++) {
+		stat = &ipc_task->stats[slot & (IPC_TASK_QUEUE_STATS - 1)];
+
+		if (stat->func == func)
+			return stat;
+
+		if (!stat->func) {
+			stat->func = func;
+			return stat;
+		}
+	}
+
+	return NULL;
+}
+
+/* Account a call of a task function, lane -1 for an event. */
+static void ipc_task_stat_update(struct ipc_task_queue *ipc_task,
+				 const void *func, int arg, int lane,
+				 u64 enqueue_ns, u64 start_ns, u64 end_ns)
+{
+	struct ipc_task_stat *stat = ipc_task_stat_get(ipc_task, func);
+	u64 wait_ns = start_ns - enqueue_ns;
+	u64 run_ns = end_ns - start_ns;
+
+	trace_ipc_task_run(func, arg, lane, wait_ns, run_ns);
+
+	if (!stat)
+		return;
+
+	stat->count++;
+	stat->wait_ns += wait_ns;
+	stat->wait_max_ns = max(stat->wait_max_ns, wait_ns);
+	stat->run_ns += run_ns;
+	stat->run_max_ns = max(stat->run_max_ns, run_ns);
+}
+
+/* Process the first element of the lane if it is published. Returns false
+ * if there is nothing to do. A reserved element which is not yet published
+ * stops the lane, its producer schedules the tasklet again.
+ */
+static bool ipc_task_lane_process(struct ipc_task_queue *ipc_task,
+				  enum ipc_task_lane_id lane_id)
+{
+	struct ipc_task_lane *lane = &ipc_task->lane[lane_id];
+	unsigned int q_rpos = lane->q_rpos;
+	struct ipc_task_queue_args *args = &lane->args[q_rpos & lane->mask];
+	unsigned int depth;
+	int response = -1;
+	u64 start_ns;
+
+	if (smp_load_acquire(&args->seq) != q_rpos + 1)
+		return false;
+
+	depth = (unsigned int)atomic_read(&lane->q_wpos) - q_rpos;
+	if (depth > lane->depth_max)
+		lane->depth_max = depth;
+
+	/* Process the input message. */
+	if (args->func) {
+		start_ns = ktime_get_ns();
+		response = args->func(args->instance, args->arg, args->msg,
+				      args->size);
+		ipc_task_stat_update(ipc_task, args->func, args->arg, lane_id,
+				     args->enqueue_ns, start_ns,
+				     ktime_get_ns());
+	}
+
+	/* Notify the caller. */
+	if (args->done)
+		args->done(args->instance, args->arg, response,
+			   args->done_ctx);
+
+	/* Free message if copy was allocated. */
+	if (args->is_copy)
+		kfree(args->msg);
+
+	/* Hand the element back to the producers for the next round of the
+	 * lane.
+	 */
+	args->done = NULL;
+	args->done_ctx = NULL;
+	args->func = NULL;
+	args->msg = NULL;
+	args->size = 0;
+	args->is_copy = false;
+	smp_store_release(&args->seq, q_rpos + lane->mask + 1);
+
+	WRITE_ONCE(lane->q_rpos, q_rpos + 1);
+
+	return true;
+}
+
 /* Actual tasklet function, will be called whenever tasklet is scheduled.
- * Calls event handler involves callback for each element in the message queue
+ * Handles the pending events, then the queued tasks within the budget. The
+ * data lane is drained before each task of the control lane.
  */
 static void ipc_task_queue_handler(unsigned long data)
 {
 	struct ipc_task_queue *ipc_task = (struct ipc_task_queue *)data;
-	unsigned int q_rpos = ipc_task->q_rpos;
-
-	/* Loop over the input queue contents. */
-	while (q_rpos != ipc_task->q_wpos) {
-		/* Get the current first queue element. */
-		struct ipc_task_queue_args *args = &ipc_task->args[q_rpos];
-
-		/* Process the input message. */
-		if (args->func)
-			args->response = args->func(args->instance, args->arg,
-						    args->msg, args->size);
-
-		/* Signal completion for synchronous calls */
-		if (args->completion)
-			complete(args->completion);
-
-		/* Free message if copy was allocated. */
-		if (args->is_copy)
-			kfree(args->msg);
-
-		/* Set invalid queue element. Technically
-		 * spin_lock_irqsave is not required here as
-		 * the array element has been processed already
-		 * so we can assume that immediately after processing
-		 * ipc_task element, queue will not rotate again to
-		 * ipc_task same element within such short time.
-		 */
-		args->completion = NULL;
-		args->func = NULL;
-		args->msg = NULL;
-		args->size = 0;
-		args->is_copy = false;
-
-		/* calculate the new read ptr and update the volatile read
-		 * ptr
-		 */
-		q_rpos = (q_rpos + 1) % IPC_THREAD_QUEUE_SIZE;
-		ipc_task->q_rpos = q_rpos;
+	u64 time_limit = ktime_get_ns() +
+			 IPC_TASK_QUEUE_BUDGET_USECS * NSEC_PER_USEC;
+	int budget = IPC_TASK_QUEUE_BUDGET;
+	int ev;
+
+	/* Handle the pending events once. An event set again from here on
+	 * schedules the tasklet again.
+	 */
+	for_each_set_bit(ev, ipc_task->events, IPC_TASK_EV_MAX) {
+		struct ipc_task_queue_event *event = &ipc_task->event_fn[ev];
+		u64 enqueue_ns = event->enqueue_ns;
+		int (*func)(struct iosm_imem *ipc_imem, int arg, void *msg,
+			    size_t size);
+		u64 start_ns;
+
+		if (!test_and_clear_bit(ev, ipc_task->events))
+			continue;
+
+		/* Call and account the handler seen by the NULL check. */
+		func = READ_ONCE(event->func);
+		if (!func)
+			continue;
+
+		start_ns = ktime_get_ns();
+		func(event->instance, event->arg, NULL, 0);
+		ipc_task_stat_update(ipc_task, func, event->arg, -1,
+				     enqueue_ns, start_ns, ktime_get_ns());
 	}
+
+	for (;;) {
+		if (!ipc_task_lane_process(ipc_task, IPC_TASK_LANE_DATA) &&
+		    !ipc_task_lane_process(ipc_task, IPC_TASK_LANE_CTRL))
+			return;
+
+		if (--budget <= 0) {
+			ipc_task->nr_budget_tasks++;
+			break;
+		}
+
+		if (ktime_get_ns() >= time_limit) {
+			ipc_task->nr_budget_time++;
+			break;
+		}
+	}
+
+	/* Let the other softirqs run, the remaining tasks follow in the
+	 * next run.
+	 */
+	tasklet_schedule(ipc_task->tasklet);
 }
 
 /* Free memory alloc and trigger completions left in the queue during dealloc */
 static void ipc_task_queue_cleanup(struct ipc_task_queue *ipc_task)
 {
-	unsigned int q_rpos = ipc_task->q_rpos;
+	struct ipc_task_queue_args *args;
+	struct ipc_task_lane *lane;
+	unsigned int q_rpos;
+	int i;
+
+	for (i = 0; i < IPC_TASK_LANE_MAX; i++) {
+		lane = &ipc_task->lane[i];
 
-	while (q_rpos != ipc_task->q_wpos) {
-		struct ipc_task_queue_args *args = &ipc_task->args[q_rpos];
+		if (!lane->args)
+			continue;
 
-		if (args->completion)
-			complete(args->completion);
+		for (q_rpos = lane->q_rpos;; q_rpos++) {
+			args = &lane->args[q_rpos & lane->mask];
 
-		if (args->is_copy)
-			kfree(args->msg);
+			if (smp_load_acquire(&args->seq) != q_rpos + 1)
+				break;
 
-		q_rpos = (q_rpos + 1) % IPC_THREAD_QUEUE_SIZE;
-		ipc_task->q_rpos = q_rpos;
+			if (args->done)
+				args->done(args->instance, args->arg, -1,
+					   args->done_ctx);
+
+			if (args->is_copy)
+				kfree(args->msg);
+		}
+
+		dev_dbg(ipc_task->dev, "%s lane: depth %u, %d retries, %d full",
+			ipc_task_lane_name[i], lane->depth_max,
+			atomic_read(&lane->nr_retries),
+			atomic_read(&lane->nr_full));
+
+		kfree(lane->args);
+		lane->args = NULL;
+	}
+
+	dev_dbg(ipc_task->dev, "budget exhausted: %u tasks, %u time",
+		ipc_task->nr_budget_tasks, ipc_task->nr_budget_time);
+}
+
+/* Print the statistics of the task queue. They are updated by the tasklet
+ * without a lock, a read may see a partial update.
+ */
+static int ipc_task_queue_stats_show(struct seq_file *m, void *v)
+{
+	struct ipc_task_queue *ipc_task = m->private;
+	struct ipc_task_stat *stat;
+	struct ipc_task_lane *lane;
+	u64 count;
+	int i;
+
+	seq_puts(m, "lane depth_max retries full\n");
+	for (i = 0; i < IPC_TASK_LANE_MAX; i++) {
+		lane = &ipc_task->lane[i];
+		seq_printf(m, "%s %u %d %d\n", ipc_task_lane_name[i],
+			   READ_ONCE(lane->depth_max),
+			   atomic_read(&lane->nr_retries),
+			   atomic_read(&lane->nr_full));
+	}
+
+	seq_printf(m, "budget exhausted: %u tasks, %u time\n",
+		   READ_ONCE(ipc_task->nr_budget_tasks),
+		   READ_ONCE(ipc_task->nr_budget_time));
+
+	seq_puts(m,
+		 "func count wait_avg_ns wait_max_ns run_avg_ns run_max_ns\n");
+	for (i = 0; i < IPC_TASK_QUEUE_STATS; i++) {
+		stat = &ipc_task->stats[i];
+		count = READ_ONCE(stat->count);
+		if (!count)
+			continue;
+
+		seq_printf(m, "%ps %llu %llu %llu %llu %llu\n", stat->func,
+			   count, div64_u64(stat->wait_ns, count),
+			   stat->wait_max_ns, div64_u64(stat->run_ns, count),
+			   stat->run_max_ns);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ipc_task_queue_stats);
+
+/* Reserve a queue element without a lock: the element at q_wpos is free if
+ * its sequence number equals the position. The producer which moves q_wpos
+ * owns it.
+ */
+static struct ipc_task_queue_args *
+ipc_task_lane_reserve(struct ipc_task_lane *lane, unsigned int *ppos)
+{
+	unsigned int pos = (unsigned int)atomic_read(&lane->q_wpos);
+	struct ipc_task_queue_args *args;
+	int diff;
+
+	for (;;) {
+		args = &lane->args[pos & lane->mask];
+		diff = (int)(smp_load_acquire(&args->seq) - pos);
+
+		if (diff == 0) {
+			if (atomic_try_cmpxchg(&lane->q_wpos, (int *)&pos,
+					       (int)(pos + 1)))
+				break;
+		} else if (diff < 0) {
+			/* The tasklet has not yet freed the element. */
+			atomic_inc(&lane->nr_full);
+			return NULL;
+		} else {
+			pos = (unsigned int)atomic_read(&lane->q_wpos);
+		}
+
+		atomic_inc(&lane->nr_retries);
 	}
+
+	*ppos = pos;
+	return args;
 }
 
 /* Add a message to the queue and trigger the ipc_task. */
 static int
 ipc_task_queue_add_task(struct tasklet_struct *ipc_tasklet,
 			struct ipc_task_queue *ipc_task,
-			int arg, void *argmnt,
+			enum ipc_task_lane_id lane_id, int arg, void *argmnt,
 			int (*func)(struct iosm_imem *ipc_imem, int arg,
 				    void *msg, size_t size),
-			void *instance, size_t size, bool is_copy, bool wait)
+			void *instance, size_t size, bool is_copy,
+			void (*done)(struct iosm_imem *ipc_imem, int arg,
+				     int response, void *ctx),
+			void *done_ctx)
 {
-	struct completion completion;
-	unsigned int pos, nextpos;
-	unsigned long flags;
-	int result = -1;
+	struct ipc_task_lane *lane = &ipc_task->lane[lane_id];
+	struct ipc_task_queue_args *args;
+	unsigned int pos;
 
-	init_completion(&completion);
+	/* tasklet send may be called from interrupt, softirq or thread
+	 * context. Keep the time between reserve and publish short, the
+	 * tasklet stops at an element which is not yet published.
+	 */
+	preempt_disable();
+
+	args = ipc_task_lane_reserve(lane, &pos);
+	if (!args) {
+		preempt_enable();
+		trace_ipc_task_full(func, arg, lane_id);
+		dev_err_ratelimited(ipc_task->dev, "%s lane is full (%d)",
+				    ipc_task_lane_name[lane_id],
+				    atomic_read(&lane->nr_full));
+		return -1;
+	}
 
-	/* tasklet send may be called from both interrupt or thread
-	 * context, therefore protect queue operation by spinlock
+	/* A small message is copied into the element, it stays valid until
+	 * the tasklet function returns.
 	 */
-	spin_lock_irqsave(&ipc_task->q_lock, flags);
-
-	pos = ipc_task->q_wpos;
-	nextpos = (pos + 1) % IPC_THREAD_QUEUE_SIZE;
-
-	/* Get next queue position. */
-	if (nextpos != ipc_task->q_rpos) {
-		/* Get the reference to the queue element and save the passed
-		 * values.
-		 */
-		ipc_task->args[pos].arg = arg;
-		ipc_task->args[pos].msg = argmnt;
-		ipc_task->args[pos].func = func;
-		ipc_task->args[pos].instance = instance;
-		ipc_task->args[pos].size = size;
-		ipc_task->args[pos].is_copy = is_copy;
-		ipc_task->args[pos].completion = wait ? &completion : NULL;
-		ipc_task->args[pos].response = -1;
-
-		/* apply write barrier so that ipc_task->q_rpos elements
-		 * are updated before ipc_task->q_wpos is being updated.
-		 */
-		smp_wmb();
-
-		/* Update the status of the free queue space. */
-		ipc_task->q_wpos = nextpos;
-		result = 0;
+	if (size > 0 && !is_copy) {
+		memcpy(args->data, argmnt, size);
+		argmnt = args->data;
 	}
 
-	spin_unlock_irqrestore(&ipc_task->q_lock, flags);
+	args->arg = arg;
+	args->msg = argmnt;
+	args->func = func;
+	args->instance = instance;
+	args->size = size;
+	args->is_copy = is_copy;
+	args->done = done;
+	args->done_ctx = done_ctx;
+	args->enqueue_ns = ktime_get_ns();
 
-	if (result == 0) {
-		tasklet_schedule(ipc_tasklet);
+	trace_ipc_task_add(func, arg, lane_id,
+			   pos + 1 - READ_ONCE(lane->q_rpos));
 
-		if (wait) {
-			wait_for_completion(&completion);
-			result = ipc_task->args[pos].response;
-		}
-	} else {
-		dev_err(ipc_task->dev, "queue is full");
-	}
+	/* Publish the element to the tasklet. */
+	smp_store_release(&args->seq, pos + 1);
+
+	preempt_enable();
 
-	return result;
+	tasklet_schedule(ipc_tasklet);
+
+	return 0;
 }
 
-int ipc_task_queue_send_task(struct iosm_imem *imem,
-			     int (*func)(struct iosm_imem *ipc_imem, int arg,
-					 void *msg, size_t size),
-			     int arg, void *msg, size_t size, bool wait)
+int ipc_task_queue_send_async(struct iosm_imem *imem,
+			      enum ipc_task_lane_id lane,
+			      int (*func)(struct iosm_imem *ipc_imem, int arg,
+					  void *msg, size_t size),
+			      int arg, void *msg, size_t size,
+			      void (*done)(struct iosm_imem *ipc_imem, int arg,
+					   int response, void *ctx),
+			      void *done_ctx)
 {
 	struct tasklet_struct *ipc_tasklet = imem->ipc_tasklet;
 	struct ipc_task_queue *ipc_task = imem->ipc_task;
 	bool is_copy = false;
 	void *copy = msg;
 
-	if (size > 0) {
+	if (size > IPC_TASK_QUEUE_INLINE_SIZE) {
 		copy = kmemdup(msg, size, GFP_ATOMIC);
 		if (!copy)
 			return -ENOMEM;
@@ -201,8 +525,9 @@ int ipc_task_queue_send_task(struct iosm_imem *imem,
 		is_copy = true;
 	}
 
-	if (ipc_task_queue_add_task(ipc_tasklet, ipc_task, arg, copy, func,
-				    imem, size, is_copy, wait) < 0) {
+	if (ipc_task_queue_add_task(ipc_tasklet, ipc_task, lane, arg, copy,
+				    func, imem, size, is_copy, done,
+				    done_ctx)) {
 		dev_err(ipc_task->dev,
 			"add task failed for %ps %d, %p, %zu, %d", func, arg,
 			copy, size, is_copy);
@@ -214,30 +539,131 @@ int ipc_task_queue_send_task(struct iosm_imem *imem,
 	return 0;
 }
 
+/* Completion callback of a synchronous call. */
+static void ipc_task_queue_wake(struct iosm_imem *ipc_imem, int arg,
+				int response, void *ctx)
+{
+	struct ipc_task_queue_wait *wait = ctx;
+
+	wait->response = response;
+	complete(&wait->completion);
+}
+
+int ipc_task_queue_send_lane(struct iosm_imem *imem,
+			     enum ipc_task_lane_id lane,
+			     int (*func)(struct iosm_imem *ipc_imem, int arg,
+					 void *msg, size_t size),
+			     int arg, void *msg, size_t size, bool wait)
+{
+	struct ipc_task_queue_wait waiter;
+
+	if (!wait)
+		return ipc_task_queue_send_async(imem, lane, func, arg, msg,
+						 size, NULL, NULL);
+
+	waiter.response = -1;
+	init_completion(&waiter.completion);
+
+	if (ipc_task_queue_send_async(imem, lane, func, arg, msg, size,
+				      ipc_task_queue_wake, &waiter))
+		return -1;
+
+	wait_for_completion(&waiter.completion);
+
+	return waiter.response;
+}
+
+int ipc_task_queue_send_task(struct iosm_imem *imem,
+			     int (*func)(struct iosm_imem *ipc_imem, int arg,
+					 void *msg, size_t size),
+			     int arg, void *msg, size_t size, bool wait)
+{
+	return ipc_task_queue_send_lane(imem, IPC_TASK_LANE_CTRL, func, arg,
+					msg, size, wait);
+}
+
+void ipc_task_queue_event_init(struct iosm_imem *imem,
+			       enum ipc_task_event event,
+			       int (*func)(struct iosm_imem *ipc_imem, int arg,
+					   void *msg, size_t size),
+			       int arg)
+{
+	struct ipc_task_queue_event *event_fn;
+
+	event_fn = &imem->ipc_task->event_fn[event];
+	event_fn->instance = imem;
+	event_fn->arg = arg;
+	WRITE_ONCE(event_fn->func, func);
+}
+
+void ipc_task_queue_send_event(struct iosm_imem *imem,
+			       enum ipc_task_event event)
+{
+	struct ipc_task_queue *ipc_task = imem->ipc_task;
+
+	if (!test_bit(event, ipc_task->events))
+		ipc_task->event_fn[event].enqueue_ns = ktime_get_ns();
+
+	/* The tasklet is already due if the event was pending. */
+	if (!test_and_set_bit(event, ipc_task->events))
+		tasklet_schedule(imem->ipc_tasklet);
+}
+
 struct ipc_task_queue *ipc_task_queue_init(struct tasklet_struct *ipc_tasklet,
 					   struct device *dev)
 {
-	struct ipc_task_queue *ipc_task = kzalloc(sizeof(*ipc_task),
-						  GFP_KERNEL);
+	struct ipc_task_queue *ipc_task = kzalloc_node(sizeof(*ipc_task),
+						       GFP_KERNEL,
+						       dev_to_node(dev));
+	struct ipc_task_lane *lane;
+	char dbg_name[32];
+	unsigned int j;
+	int i;
 
 	if (!ipc_task)
 		return NULL;
 
 	ipc_task->dev = dev;
+	ipc_task->tasklet = ipc_tasklet;
 
-	/* Initialize the spinlock needed to protect the message queue of the
-	 * ipc_task
-	 */
-	spin_lock_init(&ipc_task->q_lock);
+	for (i = 0; i < IPC_TASK_LANE_MAX; i++) {
+		lane = &ipc_task->lane[i];
+
+		lane->args = kcalloc_node(ipc_task_lane_size[i],
+					  sizeof(*lane->args), GFP_KERNEL,
+					  dev_to_node(dev));
+		if (!lane->args)
+			goto lane_alloc_fail;
+
+		lane->mask = ipc_task_lane_size[i] - 1;
+
+		/* All elements are free for the first round of the lane. */
+		for (j = 0; j < ipc_task_lane_size[i]; j++)
+			lane->args[j].seq = j;
+	}
 
 	tasklet_init(ipc_tasklet, ipc_task_queue_handler,
 		     (unsigned long)ipc_task);
 
+	/* The statistics are optional, a debugfs failure is ignored. */
+	snprintf(dbg_name, sizeof(dbg_name), "iosm-%s", dev_name(dev));
+	ipc_task->dbg_dir = debugfs_create_dir(dbg_name, NULL);
+	debugfs_create_file("task_queue", 0400, ipc_task->dbg_dir, ipc_task,
+			    &ipc_task_queue_stats_fops);
+
 	return ipc_task;
+
+lane_alloc_fail:
+	while (i--)
+		kfree(ipc_task->lane[i].args);
+	kfree(ipc_task);
+	return NULL;
 }
 
 void ipc_task_queue_deinit(struct ipc_task_queue *ipc_task)
 {
+	debugfs_remove_recursive(ipc_task->dbg_dir);
+
 	/* This will free/complete any outstanding messages,
 	 * without calling the actual handler
 	 */
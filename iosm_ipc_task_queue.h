@@ -10,6 +10,42 @@
 
 #include "iosm_ipc_imem.h"
 
+/**
+ * enum ipc_task_event - Idempotent events of the IPC tasklet. An event set
+ *			 again before the tasklet has handled it is handled
+ *			 once.
+ * @IPC_TASK_EV_IRQ:		Process the MSI. The irq vector is added to
+ *				the event.
+ * @IPC_TASK_EV_SIO_WRITE:	Pass the accumulated UL buffers to CP
+ * @IPC_TASK_EV_MUX_UL_ENCODE:	Encode the UL data of the MUX sessions
+ * @IPC_TASK_EV_TD_UPDATE:	TD update timer expired
+ * @IPC_TASK_EV_FAST_UPDATE:	Fast update timer expired
+ * @IPC_TASK_EV_TD_ALLOC:	Retry the DL buffer allocation
+ * @IPC_TASK_EV_MAX:		Number of events
+ */
+enum ipc_task_event {
+	IPC_TASK_EV_IRQ,
+	IPC_TASK_EV_SIO_WRITE = IPC_TASK_EV_IRQ + IPC_IRQ_VECTORS,
+	IPC_TASK_EV_MUX_UL_ENCODE,
+	IPC_TASK_EV_TD_UPDATE,
+	IPC_TASK_EV_FAST_UPDATE,
+	IPC_TASK_EV_TD_ALLOC,
+	IPC_TASK_EV_MAX,
+};
+
+/**
+ * enum ipc_task_lane_id - Lanes of the task queue. The tasklet drains the
+ *			   data lane before each task of the control lane.
+ * @IPC_TASK_LANE_DATA:	Tasks of the packet path
+ * @IPC_TASK_LANE_CTRL:	Control plane tasks
+ * @IPC_TASK_LANE_MAX:	Number of lanes
+ */
+enum ipc_task_lane_id {
+	IPC_TASK_LANE_DATA,
+	IPC_TASK_LANE_CTRL,
+	IPC_TASK_LANE_MAX,
+};
+
 /**
  * ipc_task_queue_init - Allocate a tasklet
  * @ipc_tasklet:	Pointer to tasklet_struct
@@ -26,9 +62,56 @@ struct ipc_task_queue *ipc_task_queue_init(struct tasklet_struct *ipc_tasklet,
  */
 void ipc_task_queue_deinit(struct ipc_task_queue *ipc_task);
 
+/**
+ * ipc_task_queue_send_async - Call a function in tasklet context and notify
+ *			       the caller through a completion callback.
+ * @imem:		Pointer to iosm_imem struct
+ * @lane:		Lane of the task queue
+ * @func:		Function to be called in tasklet context
+ * @arg:		Integer argument for func
+ * @msg:		Message pointer argument for func, copied if size is
+ *			not zero
+ * @size:		Size argument for func
+ * @done:		Called in tasklet context with arg and the result of
+ *			func, or with -1 if the queue is freed before func
+ *			ran. May be NULL.
+ * @done_ctx:		Context argument for done
+ *
+ * Returns: 0 if the task is queued, -ENOMEM or -1 on failure. done is not
+ *	    called on failure.
+ */
+int ipc_task_queue_send_async(struct iosm_imem *imem,
+			      enum ipc_task_lane_id lane,
+			      int (*func)(struct iosm_imem *ipc_imem, int arg,
+					  void *msg, size_t size),
+			      int arg, void *msg, size_t size,
+			      void (*done)(struct iosm_imem *ipc_imem, int arg,
+					   int response, void *ctx),
+			      void *done_ctx);
+
+/**
+ * ipc_task_queue_send_lane - Synchronously/Asynchronously call a function in
+ *			      tasklet context through the given lane.
+ * @imem:		Pointer to iosm_imem struct
+ * @lane:		Lane of the task queue
+ * @func:		Function to be called in tasklet context
+ * @arg:		Integer argument for func
+ * @msg:		Message pointer argument for func
+ * @size:		Size argument for func
+ * @wait:		if true wait for result
+ *
+ * Returns: Result value returned by func if wait is true, else 0. -1 if func
+ *	    could not be called.
+ */
+int ipc_task_queue_send_lane(struct iosm_imem *imem,
+			     enum ipc_task_lane_id lane,
+			     int (*func)(struct iosm_imem *ipc_imem, int arg,
+					 void *msg, size_t size),
+			     int arg, void *msg, size_t size, bool wait);
+
 /**
  * ipc_task_queue_send_task - Synchronously/Asynchronously call a function in
- *			      tasklet context.
+ *			      tasklet context through the control lane.
  * @imem:		Pointer to iosm_imem struct
  * @func:		Function to be called in tasklet context
  * @arg:		Integer argument for func
@@ -36,11 +119,38 @@ void ipc_task_queue_deinit(struct ipc_task_queue *ipc_task);
  * @size:		Size argument for func
  * @wait:		if true wait for result
  *
- * Returns: Result value returned by func or -1 if func could not be called.
+ * Returns: Result value returned by func if wait is true, else 0. -1 if func
+ *	    could not be called.
  */
 int ipc_task_queue_send_task(struct iosm_imem *imem,
 			     int (*func)(struct iosm_imem *ipc_imem, int arg,
 					 void *msg, size_t size),
 			     int arg, void *msg, size_t size, bool wait);
 
+/**
+ * ipc_task_queue_event_init - Set the function which handles an event.
+ * @imem:	Pointer to iosm_imem struct
+ * @event:	Event
+ * @func:	Function to be called in tasklet context, NULL to ignore the
+ *		event
+ * @arg:	Integer argument for func
+ *
+ * A handler cleared outside of the tasklet may still run once. Clear it
+ * from a task before freeing the data it uses.
+ */
+void ipc_task_queue_event_init(struct iosm_imem *imem,
+			       enum ipc_task_event event,
+			       int (*func)(struct iosm_imem *ipc_imem, int arg,
+					   void *msg, size_t size),
+			       int arg);
+
+/**
+ * ipc_task_queue_send_event - Mark an event pending and schedule the tasklet.
+ *			       May be called in any context.
+ * @imem:	Pointer to iosm_imem struct
+ * @event:	Event
+ */
+void ipc_task_queue_send_event(struct iosm_imem *imem,
+			       enum ipc_task_event event);
+
 #endif
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Copyright (C) 2020 Intel Corporation.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM iosm
+
+#if !defined(IOSM_IPC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define IOSM_IPC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A task is queued in a lane of the IPC task queue. depth is the number of
+ * tasks in the lane including the new one.
+ */
+TRACE_EVENT(ipc_task_add,
+	    TP_PROTO(const void *func, int arg, int lane, unsigned int depth),
+
+	    TP_ARGS(func, arg, lane, depth),
+
+	    TP_STRUCT__entry(__field(const void *, func)
+			     __field(int, arg)
+			     __field(int, lane)
+			     __field(unsigned int, depth)),
+
+	    TP_fast_assign(__entry->func = func;
+			   __entry->arg = arg;
+			   __entry->lane = lane;
+			   __entry->depth = depth;),
+
+	    TP_printk("func=%ps arg=%d lane=%d depth=%u", __entry->func,
+		      __entry->arg, __entry->lane, __entry->depth));
+
+/* A task is rejected on a full lane. */
+TRACE_EVENT(ipc_task_full,
+	    TP_PROTO(const void *func, int arg, int lane),
+
+	    TP_ARGS(func, arg, lane),
+
+	    TP_STRUCT__entry(__field(const void *, func)
+			     __field(int, arg)
+			     __field(int, lane)),
+
+	    TP_fast_assign(__entry->func = func;
+			   __entry->arg = arg;
+			   __entry->lane = lane;),
+
+	    TP_printk("func=%ps arg=%d lane=%d", __entry->func, __entry->arg,
+		      __entry->lane));
+
+/* The tasklet has run a task or, with lane -1, an event. wait_ns is the time
+ * from the enqueue to the start of func, run_ns the run time of func.
+ */
+TRACE_EVENT(ipc_task_run,
+	    TP_PROTO(const void *func, int arg, int lane, u64 wait_ns,
+		     u64 run_ns),
+
+	    TP_ARGS(func, arg, lane, wait_ns, run_ns),
+
+	    TP_STRUCT__entry(__field(const void *, func)
+			     __field(int, arg)
+			     __field(int, lane)
+			     __field(u64, wait_ns)
+			     __field(u64, run_ns)),
+
+	    TP_fast_assign(__entry->func = func;
+			   __entry->arg = arg;
+			   __entry->lane = lane;
+			   __entry->wait_ns = wait_ns;
+			   __entry->run_ns = run_ns;),
+
+	    TP_printk("func=%ps arg=%d lane=%d wait_ns=%llu run_ns=%llu",
+		      __entry->func, __entry->arg, __entry->lane,
+		      __entry->wait_ns, __entry->run_ns));
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE iosm_ipc_trace
+#include <trace/define_trace.h>
@@ -14,6 +14,7 @@
 #define UEVENT_CD_READY "CD_READY"
 #define UEVENT_CD_READY_LINK_DOWN "CD_READY_LINK_DOWN"
 #define UEVENT_MDM_TIMEOUT "MDM_TIMEOUT"
+#define UEVENT_MUX_SESSION_FAILED "MUX_SESSION_FAILED"
 
 /* Maximum length of user events */
 #define MAX_UEVENT_LEN 64
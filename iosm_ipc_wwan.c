@@ -18,7 +18,8 @@
 #define WWAN_ROOT_VLAN_TAG (0)
 
 #define IPC_MEM_MIN_MTU_SIZE (68)
-#define IPC_MEM_MAX_MTU_SIZE (1024 * 1024)
+/* A DL packet larger than the buffer is reassembled from several TDs. */
+#define IPC_MEM_MAX_MTU_SIZE (IPC_MEM_MAX_DL_FRAME_SIZE - ETH_HLEN)
 
 #define IPC_MEM_VLAN_TO_SESSION (1)
 
@@ -81,22 +82,33 @@ static int ipc_wwan_get_vlan_devs_nr(struct iosm_wwan *ipc_wwan, u16 tag)
 
 static int ipc_wwan_add_vlan(struct iosm_wwan *ipc_wwan, u16 vid)
 {
-	if (vid >= 512 || !ipc_wwan->vlan_devs)
+	if (!ipc_wwan->vlan_devs)
 		return -EINVAL;
 
 	if (vid == WWAN_ROOT_VLAN_TAG)
 		return 0;
 
+	/* IP sessions up to the negotiated count, then the control range */
+	if (vid > ipc_wwan->max_ip_devs &&
+	    (vid < IMEM_WWAN_CTRL_VLAN_ID_START ||
+	     vid >= IMEM_WWAN_CTRL_VLAN_ID_END))
+		return -EINVAL;
+
 	mutex_lock(&ipc_wwan->if_mutex);
 
+	if (ipc_wwan->vlan_devs_nr >= ipc_wwan->max_devs) {
+		mutex_unlock(&ipc_wwan->if_mutex);
+		return -ENOSPC;
+	}
+
 	/* get channel id */
 	ipc_wwan->vlan_devs[ipc_wwan->vlan_devs_nr].ch_id =
 		imem_sys_wwan_open(ipc_wwan->ops_instance, vid);
 
 	if (ipc_wwan->vlan_devs[ipc_wwan->vlan_devs_nr].ch_id < 0) {
 		dev_err(ipc_wwan->dev,
-			"cannot connect wwan0 & id %d to the IPC mem layer",
-			vid);
+			"cannot connect %s & id %d to the IPC mem layer",
+			ipc_wwan->netdev->name, vid);
 		mutex_unlock(&ipc_wwan->if_mutex);
 		return -ENODEV;
 	}
@@ -246,7 +258,7 @@ static int ipc_wwan_stop(struct net_device *netdev)
 }
 
 int ipc_wwan_receive(struct iosm_wwan *ipc_wwan, struct sk_buff *skb_arg,
-		     bool dss)
+		     __be16 proto)
 {
 	struct sk_buff *skb = skb_arg;
 	struct ethhdr *eth = (struct ethhdr *)skb->data;
@@ -264,13 +276,7 @@ int ipc_wwan_receive(struct iosm_wwan *ipc_wwan, struct sk_buff *skb_arg,
 	/* set the ethernet payload type: ipv4 or ipv6 or Dummy type
 	 * for 802.3 frames
 	 */
-	eth->h_proto = htons(ETH_P_802_3);
-	if (!dss) {
-		if ((skb->data[ETH_HLEN] & 0xF0) == 0x40)
-			eth->h_proto = htons(ETH_P_IP);
-		else if ((skb->data[ETH_HLEN] & 0xF0) == 0x60)
-			eth->h_proto = htons(ETH_P_IPV6);
-	}
+	eth->h_proto = proto;
 
 	skb->dev = ipc_wwan->netdev;
 	skb->protocol = eth_type_trans(skb, ipc_wwan->netdev);
@@ -356,15 +362,17 @@ static int ipc_wwan_transmit(struct sk_buff *skb, struct net_device *netdev)
 		     ipc_wwan->vlan_devs[idx].ch_id < 0))
 		goto exit;
 
-	/* VLAN IDs from 1 to 255 are for IP data
-	 * 257 to 512 are for non-IP data
+	/* VLAN IDs from 1 to the number of MUX sessions are for IP data
+	 * 257 to 511 are for non-IP data
 	 */
-	if ((tag > 0 && tag < 256)) {
+	if (tag >= IMEM_WWAN_DATA_VLAN_ID_START &&
+	    tag <= ipc_wwan->max_ip_devs) {
 		if (unlikely(!is_ip)) {
 			ret = -EXDEV;
 			goto exit;
 		}
-	} else if (tag > 256 && tag < 512) {
+	} else if (tag >= IMEM_WWAN_CTRL_VLAN_ID_START &&
+		   tag < IMEM_WWAN_CTRL_VLAN_ID_END) {
 		if (unlikely(is_ip)) {
 			ret = -EXDEV;
 			goto exit;
@@ -611,7 +619,8 @@ struct iosm_wwan *ipc_wwan_init(void *ops_instance, struct device *dev,
 	eth_random_addr(netdev->dev_addr);
 	netdev->addr_assign_type = NET_ADDR_RANDOM;
 
-	snprintf(netdev->name, IFNAMSIZ, "%s", "wwan0");
+	/* register_netdev() picks the next free wwan index. */
+	snprintf(netdev->name, IFNAMSIZ, "%s", "wwan%d");
 	netdev->netdev_ops = &ipc_wwandev_ops;
 	netdev->flags |= IFF_NOARP;
 	netdev->features |=
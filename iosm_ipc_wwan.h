@@ -31,13 +31,13 @@ void ipc_wwan_deinit(struct iosm_wwan *ipc_wwan);
  * ipc_wwan_receive - Receive a downlink packet from CP.
  * @ipc_wwan:	Pointer to wwan instance
  * @skb_arg:	Pointer to struct sk_buff
- * @dss:	Set to true if vlan id is greater than
- *		IMEM_WWAN_CTRL_VLAN_ID_START else false
+ * @proto:	Ethernet payload type: ETH_P_IP or ETH_P_IPV6 for an IP
+ *		session, ETH_P_802_3 for a DSS channel
  *
  * Return: 0 on success else -EINVAL or -1
  */
 int ipc_wwan_receive(struct iosm_wwan *ipc_wwan, struct sk_buff *skb_arg,
-		     bool dss);
+		     __be16 proto);
 
 /**
  * ipc_wwan_update_stats - Update device statistics